@@ -0,0 +1,20 @@
+#version 330
+
+// From vertex shader
+in vec2 texcoord;
+in vec4 light;
+in float edge_intensity;
+
+// Output color, added onto the light buffer
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	float dist = length(texcoord * 2.0 - 1.0);
+	if (dist > 1.0)
+		discard;
+
+	// linear falloff from the center to the edge
+	float intensity = mix(1.0, edge_intensity, dist) * light.a;
+	color = vec4(light.rgb * intensity, 1.0);
+}
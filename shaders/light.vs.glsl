@@ -0,0 +1,29 @@
+#version 330
+
+// Input attributes
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
+
+// Per instance attributes of the lights, see SpriteInstance in render_system.hpp
+layout(location = 3) in vec3 in_translate_angle; // xy is the center of the light
+layout(location = 4) in vec2 in_scale;           // diameter of the light, may differ per axis
+layout(location = 5) in vec4 in_frame;           // x is the intensity left at the edge
+layout(location = 6) in vec4 in_tint;            // rgb is the light color, a its intensity
+
+// Passed to fragment shader
+out vec2 texcoord;
+out vec4 light;
+out float edge_intensity;
+
+// Application data
+uniform mat3 projection;
+
+void main()
+{
+	texcoord = in_texcoord;
+	light = in_tint;
+	edge_intensity = in_frame.x;
+
+	vec3 pos = projection * vec3(in_position.xy * in_scale + in_translate_angle.xy, 1.0);
+	gl_Position = vec4(pos.xy, in_position.z, 1.0);
+}
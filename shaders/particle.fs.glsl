@@ -0,0 +1,17 @@
+#version 330
+
+// From vertex shader
+in vec2 corner;
+in vec4 particle_color;
+
+// Output color, added onto the scene
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	// soft round dots
+	float dist = length(corner);
+	if (dist > 1.0)
+		discard;
+	color = vec4(particle_color.rgb, particle_color.a * (1.0 - dist));
+}
@@ -0,0 +1,57 @@
+#version 330
+
+// Per burst attributes, see ParticleBurst in render_system.hpp. There are no per vertex attributes,
+// each particle of the burst is a quad of 6 vertices made up from gl_VertexID.
+layout(location = 3) in vec4 in_origin_time; // position, emit time, lifetime
+layout(location = 4) in vec4 in_velocity;    // emitter velocity, speed, speed spread
+layout(location = 5) in vec4 in_color;       // rgb, seed
+layout(location = 6) in vec4 in_shape;       // count, start size, end size, drag
+
+// Passed to fragment shader
+out vec2 corner;
+out vec4 particle_color;
+
+// Application data
+uniform mat3 projection;
+uniform float time; // seconds, same clock as the emit times
+
+const vec2 CORNERS[6] = vec2[](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+	vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+float hash(float n)
+{
+	return fract(sin(n) * 43758.5453);
+}
+
+void main()
+{
+	int particle = gl_VertexID / 6;
+	corner = CORNERS[gl_VertexID % 6];
+
+	float seed = in_color.w * 17.13 + float(particle) * 1.618;
+	float age = time - in_origin_time.z;
+	float lifetime = in_origin_time.w * mix(0.5, 1.0, hash(seed + 0.3));
+
+	// dead particles end up outside of the clip volume, the draw has exactly in_shape.x of them per burst
+	if (age < 0.0 || age >= lifetime) {
+		particle_color = vec4(0.0);
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	float angle = 6.2831853 * hash(seed);
+	float speed = in_velocity.z + in_velocity.w * hash(seed + 0.7);
+	vec2 velocity = in_velocity.xy + speed * vec2(cos(angle), sin(angle));
+	// exponential drag, the distance covered levels off at velocity / drag
+	float drag = in_shape.w;
+	float travelled = drag > 0.0 ? (1.0 - exp(-drag * age)) / drag : age;
+
+	float t = age / lifetime;
+	float size = mix(in_shape.y, in_shape.z, t);
+	vec2 world = in_origin_time.xy + velocity * travelled + corner * size * 0.5;
+
+	particle_color = vec4(in_color.rgb, 1.0 - t);
+	vec3 pos = projection * vec3(world, 1.0);
+	gl_Position = vec4(pos.xy, 0.0, 1.0);
+}
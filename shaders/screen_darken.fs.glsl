@@ -5,7 +5,8 @@ uniform vec2 window_size;
 uniform float screen_darken_factor;
 uniform float radius;
 uniform bool apply_spotlight;
-uniform float light_radius;
+uniform sampler2D light_map; // every light of the frame added up, at a lower resolution
+uniform vec2 render_scale; // part of screen_texture the world was rendered into
 
 in vec2 texcoord;
 
@@ -40,23 +41,12 @@ vec4 spotlight(vec4 in_color)
 	}
 }
 
-vec4 dim_light(vec4 in_color) {
-	float dist = abs(distance(vec2(0.5, 0.5), texcoord));
-
-    // If outside the light radius, darken the pixel
-    if (dist > light_radius) {
-        return vec4(0.0, 0.0, 0.0, in_color.a);
-    } else {
-        // Otherwise, apply lighting based on distance
-        float intensity = 1.0 - (dist / light_radius)*0.9;
-        return in_color * intensity;
-    }
-}
-
 void main()
 {
-	vec4 in_color = texture(screen_texture, texcoord);
-	color = dim_light(in_color);
+	// stay half a texel inside the rendered part, the cleared rest would bleed in at the edges
+	vec2 half_texel = 0.5 / vec2(textureSize(screen_texture, 0));
+	vec4 in_color = texture(screen_texture, min(texcoord * render_scale, render_scale - half_texel));
+	color = in_color * vec4(texture(light_map, texcoord).rgb, 1.0);
 	color = apply_spotlight ? spotlight(color) : color;
 	color = fade_color(color);
 }
\ No newline at end of file
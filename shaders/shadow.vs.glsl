@@ -1,19 +1,54 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec2 in_texcoord;
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
+
+// Per instance attributes of the shadow casters, see SpriteInstance in render_system.hpp
+layout(location = 3) in vec3 in_translate_angle; // xy is the position of the owner
+layout(location = 4) in vec2 in_scale;           // scale of the owner
+layout(location = 7) in vec4 in_uv_rect;         // offset and size of the texture inside its atlas
 
 // Passed to fragment shader
 out vec2 texcoord;
 
 // Application data
-uniform mat3 transform;
 uniform mat3 projection;
+uniform vec2 light_position;
+uniform float light_radius;
+uniform vec2 window_size;
+
+const float PI = 3.14159265;
 
 void main()
 {
-	texcoord = in_texcoord;
-	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
+	texcoord = in_uv_rect.xy + in_texcoord * in_uv_rect.zw;
+	vec2 owner = in_translate_angle.xy;
+
+	// outside of the light there is no shadow, the collapsed quad isn't rasterised
+	if (distance(owner / window_size, light_position / window_size) > light_radius) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	// the shadow points away from the light (PI / 2 makes it upright)
+	float angle = atan(owner.y - light_position.y, owner.x - light_position.x) + PI / 2.0;
+
+	// and shrinks towards the edge of the light
+	float max_dist = light_radius * max(window_size.x, window_size.y);
+	vec2 scale = in_scale * (max_dist - distance(owner, light_position)) / max_dist;
+	scale.y *= 1.5;
+
+	vec2 center = owner;
+	center.x += cos(angle - PI / 2.0) * (scale.y / 2.0);
+	center.y += in_scale.y / 2.0 + scale.y / 2.0 * sin(angle - PI / 2.0);
+
+	// same order as Transform: scale, then rotate, then translate
+	float c = cos(angle);
+	float s = sin(angle);
+	vec2 scaled = in_position.xy * scale;
+	vec2 world = vec2(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y) + center;
+
+	vec3 pos = projection * vec3(world, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
-}
\ No newline at end of file
+}
@@ -2,17 +2,17 @@
 
 // From vertex shader
 in vec2 texcoord;
+in vec3 tint;
+flat in int mode;
+flat in vec3 bar; // fraction, logo ratio and bar ratio
+
+// SPRITE_MODE bits of render_system.hpp
+const int MODE_RAINBOW = 1;
+const int MODE_RESOURCE_BAR = 4;
 
 // Application data
 uniform sampler2D sampler0;
-uniform vec3 fcolor;
-
 uniform float time;
-uniform int frame_col;
-uniform int frame_row;
-uniform float frame_width;
-uniform float frame_height;
-uniform bool rainbow_enabled;
 
 // Output color
 layout(location = 0) out  vec4 color;
@@ -80,9 +80,10 @@ vec4 rainbow_shift(vec4 in_rgb_color)
 
 void main()
 {
-	vec2 uv = texcoord;
-	uv.x += frame_width * frame_col;
-    uv.y += frame_height * frame_row;
-    vec4 out_color = texture(sampler0, uv);
-    color = rainbow_enabled ? rainbow_shift(out_color) : out_color;
+    vec2 uv = texcoord;
+    // resource bar textures hold the empty bar on top and the full one below, they aren't in an atlas either
+    if ((mode & MODE_RESOURCE_BAR) != 0 && texcoord.x <= bar.x * bar.z + bar.y)
+        uv.y += 0.5;
+    vec4 out_color = vec4(tint, 1.0) * texture(sampler0, uv);
+    color = (mode & MODE_RAINBOW) != 0 ? rainbow_shift(out_color) : out_color;
 }
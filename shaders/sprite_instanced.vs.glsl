@@ -0,0 +1,46 @@
+#version 330
+
+// Input attributes
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec2 in_texcoord;
+
+// Per instance attributes, see SpriteInstance in render_system.hpp
+layout(location = 3) in vec3 in_translate_angle;
+layout(location = 4) in vec2 in_scale;
+layout(location = 5) in vec4 in_frame; // column, row, width and height of the animation frame in texture coordinates
+layout(location = 6) in vec4 in_tint; // rgb multiplied with the texture, a holds the SPRITE_MODE bits
+layout(location = 7) in vec4 in_uv_rect; // offset and size of the texture inside its atlas
+layout(location = 10) in vec4 in_params; // tiling scale (repeat), or fraction, logo and bar ratio (resource bar)
+
+// SPRITE_MODE bits of render_system.hpp
+const int MODE_REPEAT = 2;
+
+// Passed to fragment shader
+out vec2 texcoord;
+out vec3 tint;
+flat out int mode;
+flat out vec3 bar;
+
+// Application data
+uniform mat3 projection;
+
+void main()
+{
+	mode = int(in_tint.a + 0.5);
+	// repeat textures aren't in an atlas, their texture wraps around
+	vec2 local = in_texcoord + in_frame.xy * in_frame.zw;
+	if ((mode & MODE_REPEAT) != 0)
+		local *= in_params.xy;
+	texcoord = in_uv_rect.xy + local * in_uv_rect.zw;
+	tint = in_tint.rgb;
+	bar = in_params.xyz;
+
+	// same order as Transform: scale, then rotate, then translate
+	float c = cos(in_translate_angle.z);
+	float s = sin(in_translate_angle.z);
+	vec2 scaled = in_position.xy * in_scale;
+	vec2 world = vec2(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y) + in_translate_angle.xy;
+
+	vec3 pos = projection * vec3(world, 1.0);
+	gl_Position = vec4(pos.xy, in_position.z, 1.0);
+}
@@ -1,13 +1,17 @@
 #version 330 core
 
 in vec2 TexCoords;
+in vec3 TextColor;
 out vec4 color;
 
-uniform sampler2D text;
-uniform vec3 textColor;
+// glyph distance fields, 0.5 is the outline of the glyph and larger values are inside
+uniform sampler2D sampler0;
 
 void main()
 {    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-    color = vec4(textColor, 1.0) * sampled;
-} 
\ No newline at end of file
+    float dist = texture(sampler0, TexCoords).r;
+    // antialias over one screen pixel, whatever the scale of the text
+    float width = fwidth(dist) * 0.5;
+    float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+    color = vec4(TextColor, alpha);
+}
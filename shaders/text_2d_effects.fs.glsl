@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 TexCoords;
+in vec3 TextColor;
+in vec4 Outline;
+in vec4 Glow;
+out vec4 color;
+
+// glyph distance fields, 0.5 is the outline of the glyph and larger values are inside
+uniform sampler2D sampler0;
+
+void main()
+{    
+    float dist = texture(sampler0, TexCoords).r;
+    float width = fwidth(dist) * 0.5;
+
+    // the outline is a second, thicker glyph behind the fill
+    float fill = smoothstep(0.5 - width, 0.5 + width, dist);
+    float outline_edge = 0.5 - Outline.a;
+    float outline = Outline.a > 0.0 ? smoothstep(outline_edge - width, outline_edge + width, dist) : 0.0;
+    vec3 glyph_color = Outline.a > 0.0 ? mix(Outline.rgb, TextColor, fill) : TextColor;
+    vec4 glyph = vec4(glyph_color, max(fill, outline));
+
+    // the glow fades out over its width outside of the glyph (and its outline)
+    float glow_edge = outline_edge - Glow.a;
+    float glow = Glow.a > 0.0 ? smoothstep(glow_edge, outline_edge, dist) : 0.0;
+
+    color = vec4(mix(Glow.rgb, glyph.rgb, glyph.a), glyph.a + glow * (1.0 - glyph.a));
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) 
+in vec4 vertex; // <vec2 pos, vec2 tex>
+in vec3 in_color;
+in vec4 in_outline; // <vec3 color, width>
+in vec4 in_glow;    // <vec3 color, width>
+out vec2 TexCoords;
+out vec3 TextColor;
+out vec4 Outline;
+out vec4 Glow;
+
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+    TexCoords = vertex.zw;
+    TextColor = in_color;
+    Outline = in_outline;
+    Glow = in_glow;
+}
@@ -0,0 +1,43 @@
+#version 330
+
+// From vertex shader
+in vec2 world_position;
+
+// Application data
+uniform sampler2D sampler0;     // floor texture
+uniform usampler2D chunk_table; // per chunk, slot in chunk_atlas + 1 or 0 if the chunk is empty
+uniform usampler2D chunk_atlas; // tile ids of all chunks, chunk_slots_per_row chunks side by side
+uniform sampler2D tile_palette; // per tile id - 1, where its texture starts repeating
+uniform vec2 map_origin;
+uniform float cell_size;
+uniform int chunk_slots_per_row;
+uniform vec3 fcolor;
+
+const int CHUNK_SIZE = 64;        // TILE_MAP_CHUNK_SIZE
+const float TEXTURE_REPEAT = 100.0; // floors repeat every 100 px, see RenderSystem::repeatScale
+
+// Output color
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	ivec2 cell = ivec2(floor((world_position - map_origin) / cell_size));
+	if (any(lessThan(cell, ivec2(0))))
+		discard;
+	ivec2 chunk = cell / CHUNK_SIZE;
+	if (any(greaterThanEqual(chunk, textureSize(chunk_table, 0))))
+		discard;
+
+	uint slot = texelFetch(chunk_table, chunk, 0).r;
+	if (slot == 0u)
+		discard;
+	int index = int(slot) - 1;
+	ivec2 slot_corner = ivec2(index % chunk_slots_per_row, index / chunk_slots_per_row) * CHUNK_SIZE;
+
+	uint tile = texelFetch(chunk_atlas, slot_corner + cell % CHUNK_SIZE, 0).r;
+	if (tile == 0u)
+		discard;
+	vec2 tile_origin = texelFetch(tile_palette, ivec2(int(tile) - 1, 0), 0).rg;
+
+	color = vec4(fcolor, 1.0) * texture(sampler0, (world_position - tile_origin) / TEXTURE_REPEAT);
+}
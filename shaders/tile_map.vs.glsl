@@ -0,0 +1,16 @@
+#version 330
+
+// Input attributes
+in vec3 in_position;
+
+// Passed to fragment shader
+out vec2 world_position;
+
+// Application data
+uniform mat3 transform; // inverse of the camera projection, takes the screen back into the world
+
+void main()
+{
+	world_position = (transform * vec3(in_position.xy, 1.0)).xy;
+	gl_Position = vec4(in_position.xy, 0, 1.0);
+}
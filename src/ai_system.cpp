@@ -6,10 +6,29 @@
 #include "world_system.hpp"
 #include "render_system.hpp"
 #include <chrono>
+#include <algorithm>
+#include <thread>
+#include <cfloat>
 #include <utils.hpp>
 
 #define ENEMY_PROJECTILE_SPEED 500
 
+// AI level of detail, see AISystem::step
+const float AI_NEAR_DISTANCE = 450.f; // beyond chase and dodge range
+const float AI_MID_DISTANCE = 900.f;
+const float AI_MID_AGGRAVATED_INTERVAL_MS = 50.f;
+const float AI_MID_INTERVAL_MS = 150.f;
+const float AI_FAR_INTERVAL_MS = 500.f;
+const float AI_FAR_BUDGET_US = 500.f;
+// below this many enemies deciding in a frame, waking the workers costs more than it saves
+const size_t AI_PARALLEL_MIN_JOBS = 64;
+const size_t AI_MAX_THREADS = 4;
+
+// tactics read from the influence map
+const int AI_DODGE_RINGS = 2;
+const float AI_HEAL_RANGE = 250.f;
+const float AI_CROWD_RANGE = 100.f;
+
 void animateEnemy(Entity& enemy_entity, vec2 velocity) {
 	Animation& animation = registry.animations.get(enemy_entity);
 	ENEMY_STATES state = (velocity.x > 0.f) ? ENEMY_STATES::WEST : ENEMY_STATES::EAST;
@@ -20,293 +39,438 @@ void AISystem::step(float elapsed_ms)
 {
 	auto& enemy_container = registry.enemies;
 	Entity player = registry.players.entities[0];
+
+	// restart_game recreates the player, so a new player entity means the terrain changed too
+	if (player != level_player) {
+		flow_field.build();
+		influence_map.build();
+		level_player = player;
+	}
+	flow_field.update(registry.positions.get(player).position);
+
+	vec2 playerPos = registry.positions.get(player).position;
+
+	// boss attack patterns spawn and redirect projectiles all over the level, so they stay serial
+	for (uint i = 0; i < registry.bosses.size(); i++) {
+		stepBoss(registry.bosses.entities[i], playerPos, elapsed_ms);
+	}
+
+	// read-only view of the world for the decide pass, taken after the bosses moved projectiles around
+	influence_map.updatePlayer(playerPos);
+	influence_map.updateProjectiles();
+	influence_map.updateEnemies();
+	snapshot.player_position = playerPos;
+	snapshot.enemy_index.clear();
+	snapshot.enemy_positions.resize(enemy_container.size());
+	snapshot.enemy_health.resize(enemy_container.size());
+	snapshot.enemy_types.resize(enemy_container.size());
+	for (uint i = 0; i < enemy_container.size(); i++) {
+		Entity entity_i = enemy_container.entities[i];
+		snapshot.enemy_positions[i] = registry.positions.get(entity_i).position;
+		snapshot.enemy_health[i] = registry.resources.get(entity_i).currentHealth;
+		snapshot.enemy_types[i] = enemy_container.components[i].type;
+		snapshot.enemy_index[entity_i] = i;
+	}
+
+	// enemies close to the player (and bosses) decide every frame, the rest at an interval depending on
+	// their distance and aggravation, the furthest ones share a time budget and take turns
+	jobs.clear();
+	far_enemies.clear();
 	for (uint i = 0; i < enemy_container.size(); i++)
 	{
 		Entity entity_i = enemy_container.entities[i];
-		Velocity& vel_i = registry.velocities.get(entity_i);
-		Enemy& enemy = enemy_container.get(entity_i);
-
-		vec2 playerPos = registry.positions.get(player).position;
-		vec2 thisPos = registry.positions.get(entity_i).position;
-		float dist = distance(playerPos, thisPos);
-		
-		bool canSprint = enemy.stamina > 0;
-		bool isDodging = false;
-		bool isSprinting = false;
-		bool isFlanking = false;
-
-		if (registry.bosses.has(entity_i) && enemy.isAggravated) {
-			Boss& boss = registry.bosses.get(entity_i);
-			if (boss.phaseTimer > 0.f) {
-				boss.phaseTimer -= elapsed_ms;
-			} else {
-				// printf("Resolving phase %d:%d\n", boss.phase, boss.subphase);
-				switch (boss.phase) {
-					case 0:
-						if (boss.subphase == 48) {
-							boss.phase += 1;
-							boss.phaseTimer = 5000.f;
-							boss.subphase = 0;
-						} else {
-							for (int deg = boss.subphase * 2; deg < 360 + boss.subphase * 2; deg += 120) {
-								float rad = deg * 180 / 3.14;
-								vec2 direction = {cosf(rad), sinf(rad)};
-								enemyFireProjectile(entity_i, direction, 0.5f);
-							}
-							boss.subphase += 1;
-							boss.phaseTimer = 50.f;
-						}
-						break;
-					case 1:
-					case 2:
-					case 3:
-					case 4:
-					case 5:
-					case 6:
-					case 7:
-						if (boss.subphase == 10) {
-							boss.phaseTimer = 50.f;
-							if (boss.phase == 7) {
-								boss.phaseTimer = 1500.f;
-							}
-							boss.phase += 1;
-							boss.subphase = 0;
-						} else {
-							vec2 direction = {1.f, 0.f};
-							if (boss.subphase >= 5) {
-								direction = {-1.f, 0.f};
-							}
-							// vec2 position = registry.positions.get(entity_i).position;
-							vec2 adjust = {0, (boss.phase - 4) * 50};
-							vec2 subadjust = {0, ((boss.subphase % 5) + 1) * 75 + 40};
-							enemyFireProjectile(entity_i, direction, 0.5f, thisPos - adjust + subadjust);
-							enemyFireProjectile(entity_i, direction, 0.5f, thisPos - adjust - subadjust);
-							boss.subphase += 1;
-							boss.phaseTimer = 25.f;
+		AIUpdate& update = registry.aiUpdates.get(entity_i);
+		update.pending_ms += elapsed_ms;
+
+		float dist = distance(playerPos, snapshot.enemy_positions[i]);
+		if (registry.bosses.has(entity_i) || dist <= AI_NEAR_DISTANCE) {
+			addJob(i, update);
+		} else if (dist <= AI_MID_DISTANCE) {
+			float interval = enemy_container.components[i].isAggravated ? AI_MID_AGGRAVATED_INTERVAL_MS : AI_MID_INTERVAL_MS;
+			if (update.pending_ms >= interval) addJob(i, update);
+		} else if (update.pending_ms >= AI_FAR_INTERVAL_MS) {
+			far_enemies.push_back(i);
+		}
+	}
+
+	// longest waiting first, so enemies that did not fit into the budget this frame are at the front of the queue next frame
+	std::sort(far_enemies.begin(), far_enemies.end(), [&](uint a, uint b) {
+		return registry.aiUpdates.get(enemy_container.entities[a]).pending_ms > registry.aiUpdates.get(enemy_container.entities[b]).pending_ms;
+	});
+	size_t far_allowed = std::max((size_t)1, (size_t)(AI_FAR_BUDGET_US / std::max(decide_cost_us, 1.f)));
+	for (size_t n = 0; n < far_enemies.size() && n < far_allowed; n++) {
+		addJob(far_enemies[n], registry.aiUpdates.get(enemy_container.entities[far_enemies[n]]));
+	}
+
+	// decide: every job only reads the snapshot and writes its own Enemy plus a per-thread action buffer.
+	// Jobs are split into contiguous chunks, so concatenating the buffers in thread order always gives the
+	// same actions in the same order no matter how many threads ran
+	auto decide_start = std::chrono::steady_clock::now();
+	size_t thread_count = jobs.size() >= AI_PARALLEL_MIN_JOBS ? workers.size() + 1 : 1;
+	size_t chunk = (jobs.size() + thread_count - 1) / thread_count;
+	if (thread_actions.size() < thread_count) thread_actions.resize(thread_count);
+	for (auto& actions : thread_actions) actions.clear();
+
+	if (thread_count > 1) {
+		{
+			std::lock_guard<std::mutex> lock(work_mutex);
+			work_chunk = chunk;
+			workers_busy = workers.size();
+			work_generation++;
+		}
+		work_condition.notify_all();
+	}
+	for (size_t j = 0; j < std::min(chunk, jobs.size()); j++) decideEnemy(jobs[j], thread_actions[0]);
+	if (thread_count > 1) {
+		std::unique_lock<std::mutex> lock(work_mutex);
+		done_condition.wait(lock, [this] { return workers_busy == 0; });
+	}
+
+	if (jobs.size() > 0) {
+		float frame_cost_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - decide_start).count() / (float)jobs.size();
+		decide_cost_us = 0.9f * decide_cost_us + 0.1f * frame_cost_us;
+	}
+
+	// apply: serial, in job order
+	for (auto& actions : thread_actions) {
+		for (const AIAction& action : actions) {
+			Entity entity = enemy_container.entities[action.enemy_index];
+			switch (action.type) {
+				case AIAction::STEER:
+					registry.velocities.get(entity).velocity = action.vector;
+					animateEnemy(entity, action.vector);
+					break;
+				case AIAction::FIRE:
+				case AIAction::HEAL_ALLY:
+					enemyFireProjectile(entity, action.vector);
+					break;
+			}
+		}
+	}
+}
+
+void AISystem::addJob(uint i, AIUpdate& update)
+{
+	Entity entity_i = registry.enemies.entities[i];
+	AIJob job;
+	job.index = i;
+	job.elapsed_ms = update.pending_ms;
+	job.enemy = &registry.enemies.components[i];
+	job.velocity = registry.velocities.get(entity_i).velocity;
+	job.is_boss = registry.bosses.has(entity_i);
+	jobs.push_back(job);
+	update.pending_ms = 0.f;
+}
+
+// Advances the attack pattern of an aggravated boss
+void AISystem::stepBoss(Entity entity_i, vec2 playerPos, float elapsed_ms)
+{
+	Enemy& enemy = registry.enemies.get(entity_i);
+	vec2 thisPos = registry.positions.get(entity_i).position;
+
+	if (registry.bosses.has(entity_i) && enemy.isAggravated) {
+		Boss& boss = registry.bosses.get(entity_i);
+		if (boss.phaseTimer > 0.f) {
+			boss.phaseTimer -= elapsed_ms;
+		} else {
+			// printf("Resolving phase %d:%d\n", boss.phase, boss.subphase);
+			switch (boss.phase) {
+				case 0:
+					if (boss.subphase == 48) {
+						boss.phase += 1;
+						boss.phaseTimer = 5000.f;
+						boss.subphase = 0;
+					} else {
+						for (int deg = boss.subphase * 2; deg < 360 + boss.subphase * 2; deg += 120) {
+							float rad = deg * 180 / 3.14;
+							vec2 direction = {cosf(rad), sinf(rad)};
+							enemyFireProjectile(entity_i, direction, 0.5f);
 						}
-						break;
-					case 8:
-						if (boss.subphase == 25) {
-							boss.phase += 1;
+						boss.subphase += 1;
+						boss.phaseTimer = 50.f;
+					}
+					break;
+				case 1:
+				case 2:
+				case 3:
+				case 4:
+				case 5:
+				case 6:
+				case 7:
+					if (boss.subphase == 10) {
+						boss.phaseTimer = 50.f;
+						if (boss.phase == 7) {
 							boss.phaseTimer = 1500.f;
-							boss.subphase = 0;
-						} else {
-							registry.resources.get(entity_i).currentHealth += 25;
-							if (registry.resources.get(entity_i).currentHealth > registry.resources.get(entity_i).maxHealth) {
-								registry.resources.get(entity_i).currentHealth = registry.resources.get(entity_i).maxHealth;
-							}
-							boss.subphase += 1;
-							boss.phaseTimer = 50.f;
-						}
-						break;
-					case 9:
-						if (boss.subphase == 4) {
-							boss.phase += 1;
-							boss.phaseTimer = 1000.f;
-							boss.subphase = 0;
-						} else {
-							for (int deg = 0; deg < 360; deg += 10) {
-								float rad = deg * 180 / 3.14;
-								vec2 direction = {cosf(rad), sinf(rad)};
-								if (boss.subphase == 0) {
-									direction *= 200;
-								} else {
-									direction *= 150 * (boss.subphase + 1);
-								}
-								enemyFireProjectile(entity_i, - direction, 0.0f, playerPos + direction);
-							}
-							boss.subphase += 1;
-							boss.phaseTimer = 100.f;
 						}
-						break;
-					case 10:
-					case 11:
-					case 12:
-					case 13:
-					case 14:
-						for (uint i = 0; i < registry.projectiles.size(); i++) {
-							Entity thisProj = registry.projectiles.entities[i];
-							if (!registry.projectiles.get(thisProj).hostile) continue;
-							Velocity& thisProjVel = registry.velocities.get(thisProj);
-							switch (boss.phase) {
-								case 10:
-									// make sure the circle does not lead back into the boss
-									thisProjVel.velocity = normalize(playerPos - thisPos);
-									thisProjVel.velocity *= 200;
-									break;
-								case 11:
-									thisProjVel.velocity = {-150, 0};
-									break;
-								case 12:
-									thisProjVel.velocity = {0, 150};
-									break;
-								case 13:
-									thisProjVel.velocity = {150, 0};
-									break;
-								case 14:
-									thisProjVel.velocity = {0, -150};
-									break;
-							}
-						}
-						boss.phaseTimer = 750.f;
-						if (boss.phase == 10) {
-							boss.phaseTimer = 1000.f;
+						boss.phase += 1;
+						boss.subphase = 0;
+					} else {
+						vec2 direction = {1.f, 0.f};
+						if (boss.subphase >= 5) {
+							direction = {-1.f, 0.f};
 						}
+						// vec2 position = registry.positions.get(entity_i).position;
+						vec2 adjust = {0, (boss.phase - 4) * 50};
+						vec2 subadjust = {0, ((boss.subphase % 5) + 1) * 75 + 40};
+						enemyFireProjectile(entity_i, direction, 0.5f, thisPos - adjust + subadjust);
+						enemyFireProjectile(entity_i, direction, 0.5f, thisPos - adjust - subadjust);
+						boss.subphase += 1;
+						boss.phaseTimer = 25.f;
+					}
+					break;
+				case 8:
+					if (boss.subphase == 25) {
 						boss.phase += 1;
+						boss.phaseTimer = 1500.f;
 						boss.subphase = 0;
-						break;
-					case 15:
-					case 16:
-						for (uint i = 0; i < registry.projectiles.size(); i++) {
-							Entity thisProj = registry.projectiles.entities[i];
-							if (!registry.projectiles.get(thisProj).hostile) continue;
-							Velocity& thisProjVel = registry.velocities.get(thisProj);
-							Position& thisProjPos = registry.positions.get(thisProj);
-							thisProjVel.velocity = normalize(thisProjPos.position - playerPos);
-							thisProjVel.velocity *= 100;
-							if (boss.phase == 15) {
-								thisProjVel.velocity *= -0.75;
-							}
+					} else {
+						registry.resources.get(entity_i).currentHealth += 25;
+						if (registry.resources.get(entity_i).currentHealth > registry.resources.get(entity_i).maxHealth) {
+							registry.resources.get(entity_i).currentHealth = registry.resources.get(entity_i).maxHealth;
 						}
+						boss.subphase += 1;
+						boss.phaseTimer = 50.f;
+					}
+					break;
+				case 9:
+					if (boss.subphase == 4) {
 						boss.phase += 1;
 						boss.phaseTimer = 1000.f;
 						boss.subphase = 0;
-						break;
-					case 17:
-						while (0 != registry.projectiles.size()) {
-							if (registry.projectiles.entities.size() != 0) {
-								registry.remove_all_components_of_no_collision(registry.projectiles.entities[0]);
+					} else {
+						ProjectileSpawn ring[36];
+						for (int deg = 0; deg < 360; deg += 10) {
+							float rad = deg * 180 / 3.14;
+							vec2 direction = {cosf(rad), sinf(rad)};
+							if (boss.subphase == 0) {
+								direction *= 200;
+							} else {
+								direction *= 150 * (boss.subphase + 1);
 							}
+							ring[deg / 10] = enemyProjectileSpawn(entity_i, - direction, 0.0f, playerPos + direction);
 						}
-						boss.phase += 1;
-						boss.phaseTimer = 1500.f;
-						boss.subphase = 0;
-						break;
-					default:
-						boss.phaseTimer = 2500.f;
-						boss.phase = 0; // reset to first phase
-						break;
-				}
+						projectile_pool.spawnBatch(ring, 36);
+						boss.subphase += 1;
+						boss.phaseTimer = 100.f;
+					}
+					break;
+				case 10:
+				case 11:
+				case 12:
+				case 13:
+				case 14:
+					for (uint i = 0; i < registry.projectiles.size(); i++) {
+						Entity thisProj = registry.projectiles.entities[i];
+						if (!registry.projectiles.get(thisProj).hostile || isInactiveProjectile(thisProj)) continue;
+						Velocity& thisProjVel = registry.velocities.get(thisProj);
+						switch (boss.phase) {
+							case 10:
+								// make sure the circle does not lead back into the boss
+								thisProjVel.velocity = normalize(playerPos - thisPos);
+								thisProjVel.velocity *= 200;
+								break;
+							case 11:
+								thisProjVel.velocity = {-150, 0};
+								break;
+							case 12:
+								thisProjVel.velocity = {0, 150};
+								break;
+							case 13:
+								thisProjVel.velocity = {150, 0};
+								break;
+							case 14:
+								thisProjVel.velocity = {0, -150};
+								break;
+						}
+					}
+					boss.phaseTimer = 750.f;
+					if (boss.phase == 10) {
+						boss.phaseTimer = 1000.f;
+					}
+					boss.phase += 1;
+					boss.subphase = 0;
+					break;
+				case 15:
+				case 16:
+					for (uint i = 0; i < registry.projectiles.size(); i++) {
+						Entity thisProj = registry.projectiles.entities[i];
+						if (!registry.projectiles.get(thisProj).hostile || isInactiveProjectile(thisProj)) continue;
+						Velocity& thisProjVel = registry.velocities.get(thisProj);
+						Position& thisProjPos = registry.positions.get(thisProj);
+						thisProjVel.velocity = normalize(thisProjPos.position - playerPos);
+						thisProjVel.velocity *= 100;
+						if (boss.phase == 15) {
+							thisProjVel.velocity *= -0.75;
+						}
+					}
+					boss.phase += 1;
+					boss.phaseTimer = 1000.f;
+					boss.subphase = 0;
+					break;
+				case 17:
+					projectile_pool.releaseAll();
+					boss.phase += 1;
+					boss.phaseTimer = 1500.f;
+					boss.subphase = 0;
+					break;
+				default:
+					boss.phaseTimer = 2500.f;
+					boss.phase = 0; // reset to first phase
+					break;
 			}
 		}
+	}
+}
 
-		if (!registry.bosses.has(entity_i)) { // bosses never dodge
-			for (uint i = 0; i < registry.projectiles.size(); i++) {
-				Entity entity_p = registry.projectiles.entities[i];
-				Projectile& projectile = registry.projectiles.get(entity_p);
-				if (projectile.hostile) continue;
-				vec2 projectilePos = registry.positions.get(entity_p).position;
-				if (distance(projectilePos, thisPos) < 300) {
-					isDodging = true;
-					if (canSprint) {
-						isSprinting = true;
-						enemy.stamina -= elapsed_ms / 1000;
-					}
+// How unpleasant it is to move towards position: player projectiles, other enemies and the player nearby
+float AISystem::sidePressure(vec2 position) const
+{
+	int cell = influence_map.cellIndex(position);
+	return 2.f * influence_map.projectileDensity(cell) + influence_map.enemyDensity(cell) + influence_map.playerThreat(cell);
+}
 
-					int deg = 90;
-					// https://stackoverflow.com/questions/16177295/get-time-since-epoch-in-milliseconds-preferably-using-c11-chrono
-					unsigned long milliseconds_since_epoch = std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1);
-					if (milliseconds_since_epoch % 10000 > 5000) {
-						deg = -90;
-					}
-					float c = cosf(deg);
-					float s = sinf(deg);
-					mat2 R = {{c, s}, {-s, c}};
-
-					vec2 direction = projectilePos - thisPos;
-					direction /= length(direction);
-					direction *= isSprinting ? 300 : 50; // allow enemies to sprint even faster to dodge
-					vel_i.velocity = direction * R;
-				}
+// Runs the decision logic for one enemy. Must not touch the registry, it may run on any thread
+void AISystem::decideEnemy(const AIJob& job, std::vector<AIAction>& actions) const
+{
+	uint i = job.index;
+	Enemy& enemy = *job.enemy; // owned by this job only
+	float elapsed_ms = job.elapsed_ms;
+	vec2 velocity = job.velocity;
+
+	vec2 playerPos = snapshot.player_position;
+	vec2 thisPos = snapshot.enemy_positions[i];
+	float dist = distance(playerPos, thisPos);
+	
+	bool canSprint = enemy.stamina > 0;
+	bool isDodging = false;
+	bool isSprinting = false;
+	bool isFlanking = false;
+
+	int cell = influence_map.cellIndex(thisPos);
+
+	if (!job.is_boss) { // bosses never dodge
+		// dodge sideways from player projectiles in the surrounding cells, towards the calmer side
+		vec2 projectileCentroid;
+		if (influence_map.projectilesAround(cell, AI_DODGE_RINGS, projectileCentroid) > 0) {
+			isDodging = true;
+			if (canSprint) {
+				isSprinting = true;
+				enemy.stamina -= elapsed_ms / 1000;
 			}
-		}
 
-		if (enemy.mana < 1.f) {
-			enemy.mana += elapsed_ms / 1000;
+			vec2 direction = projectileCentroid - thisPos;
+			direction = length(direction) > 0.f ? direction / length(direction) : vec2(1.f, 0.f);
+			vec2 left = { direction.y, -direction.x };
+			float leftPressure = sidePressure(thisPos + left * INFLUENCE_CELL_SIZE);
+			float rightPressure = sidePressure(thisPos - left * INFLUENCE_CELL_SIZE);
+			vec2 side = leftPressure <= rightPressure ? left : -left;
+			velocity = side * (isSprinting ? 300.f : 50.f); // allow enemies to sprint even faster to dodge
 		}
+	}
 
+	if (enemy.mana < 1.f) {
+		enemy.mana += elapsed_ms / 1000;
+	}
 
-		for (uint j = 0; j < enemy_container.size(); j++) {
-			if (i == j) continue;
-			Entity entity_j = enemy_container.entities[j];
-			Enemy& enemy_j = enemy_container.get(entity_j);
-			if (distance(registry.positions.get(entity_j).position, thisPos) < 250 && registry.resources.get(entity_j).currentHealth < 80 && enemy_j.type != enemy.type) {
-				vec2 direction = registry.positions.get(entity_j).position - thisPos;
-				direction /= length(direction);
-				if (enemy.mana >= 0.75f) {
-					enemyFireProjectile(entity_i, direction);
-					enemy.mana -= 0.75f;
-				}
-			}
-			// flank the player
-			if (distance(thisPos, registry.positions.get(entity_j).position) < 100 && i > j) {
-				vec2 direction = playerPos - thisPos;
-				direction /= length(direction);
-				direction *= -50;
-				if (distance(thisPos, playerPos) > 100) {
-					vel_i.velocity = direction;
-				}
-				isFlanking = true;
+	bool isCrowded = false;
+	influence_map.forEachEnemyNear(thisPos, AI_HEAL_RANGE, [&](unsigned int id) {
+		uint j = snapshot.enemy_index.at(id);
+		if (i == j) return;
+		vec2 otherPos = snapshot.enemy_positions[j];
+		float otherDist = distance(otherPos, thisPos);
+		if (otherDist < AI_HEAL_RANGE && snapshot.enemy_health[j] < 80 && snapshot.enemy_types[j] != enemy.type) {
+			vec2 direction = otherPos - thisPos;
+			direction /= length(direction);
+			if (enemy.mana >= 0.75f) {
+				actions.push_back({ AIAction::HEAL_ALLY, i, direction });
+				enemy.mana -= 0.75f;
 			}
 		}
+		// the enemy that came first keeps its course, the others spread out
+		if (otherDist < AI_CROWD_RANGE && i > j) isCrowded = true;
+	});
 
-		if (!isDodging && !isFlanking) {
-			// bosses never give chase
-			if (dist <= 350 && dist > 15 && !registry.bosses.has(entity_i) && enemy.isAggravated) {
-				if (canSprint) {
-					isSprinting = true;
-					enemy.stamina -= elapsed_ms / 1000;
-				}
-				vec2 direction = playerPos - thisPos;
-				direction /= length(direction);
-				if (enemy.mana >= 1.f) {
-					enemyFireProjectile(entity_i, direction);
-					enemy.mana -= 1.f;
-				}
-				direction *= isSprinting ? 200 : 50;
-				vel_i.velocity = direction;
-			} else if (dist > 350 || !enemy.isAggravated) {
-				vel_i.velocity.y = 0;
-				if (abs(vel_i.velocity.x) != 50) {
-					vel_i.velocity.x = 50;
-				}
-				if (enemy.movementTimer <= 0.f) {
-					enemy.movementTimer = 3000.f;
-					vel_i.velocity.x = -vel_i.velocity.x;
-				} else {
-					enemy.movementTimer -= elapsed_ms;
+	// flank the player: move to the neighbouring cell with the fewest enemies that stays about as far from the player
+	if (isCrowded) {
+		isFlanking = true;
+		if (dist > AI_CROWD_RANGE) {
+			int best = cell;
+			float bestScore = FLT_MAX;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					int n = influence_map.neighbour(cell, dx, dy);
+					float score = (float)influence_map.enemyDensity(n) +
+						abs(distance(influence_map.cellCenter(n), playerPos) - dist) / INFLUENCE_CELL_SIZE;
+					if (n != cell && score < bestScore) {
+						best = n;
+						bestScore = score;
+					}
 				}
 			}
+			vec2 direction = best != cell ? influence_map.cellCenter(best) - thisPos : thisPos - playerPos;
+			if (length(direction) > 0.f) velocity = direction / length(direction) * 50.f;
 		}
+	}
 
-		if (!isSprinting) {
-			// replenish 1 stamina per second if not sprinting
-			enemy.stamina += elapsed_ms / 1000;
+	if (!isDodging && !isFlanking) {
+		// bosses never give chase
+		if (dist <= 350 && dist > 15 && !job.is_boss && enemy.isAggravated) {
+			if (canSprint) {
+				isSprinting = true;
+				enemy.stamina -= elapsed_ms / 1000;
+			}
+			vec2 direction = playerPos - thisPos;
+			direction /= length(direction);
+			if (enemy.mana >= 1.f) {
+				actions.push_back({ AIAction::FIRE, i, direction });
+				enemy.mana -= 1.f;
+			}
+			// walk along the flow field around terrain, straight at the player once in its cell or off the grid
+			vec2 steering = flow_field.directionAt(thisPos);
+			if (steering == vec2(0.f, 0.f)) steering = direction;
+			steering *= isSprinting ? 200 : 50;
+			velocity = steering;
+		} else if (dist > 350 || !enemy.isAggravated) {
+			velocity.y = 0;
+			if (abs(velocity.x) != 50) {
+				velocity.x = 50;
+			}
+			if (enemy.movementTimer <= 0.f) {
+				enemy.movementTimer = 3000.f;
+				velocity.x = -velocity.x;
+			} else {
+				enemy.movementTimer -= elapsed_ms;
+			}
 		}
+	}
 
-		animateEnemy(entity_i, vel_i.velocity);
-
-		// Decision tree:
-		// Is there a player-made projectile within 50 pixels?
-		//   Yes -> Do I have stamina?
-		//     Yes -> Try to dodge at sprint speed
-		//     No -> Try to dodge at normal speed
-		//   No -> Is player within 350 pixels?
-		//     Yes -> Do I have mana?
-		//       Yes -> Fire a projectile at the player
-		//       No -> Do I have stamina?
-		//             Yes -> Sprint towards player
-		//             No -> Move towards player
-		//     No -> Have I moved in current direction for long enough?
-		//           Yes -> Flip direction
-		//           No -> Continue moving
+	if (!isSprinting) {
+		// replenish 1 stamina per second if not sprinting
+		enemy.stamina += elapsed_ms / 1000;
 	}
+
+	actions.push_back({ AIAction::STEER, i, velocity });
+
+	// Decision tree:
+	// Is there a player-made projectile within 50 pixels?
+	//   Yes -> Do I have stamina?
+	//     Yes -> Try to dodge at sprint speed
+	//     No -> Try to dodge at normal speed
+	//   No -> Is player within 350 pixels?
+	//     Yes -> Do I have mana?
+	//       Yes -> Fire a projectile at the player
+	//       No -> Do I have stamina?
+	//             Yes -> Sprint towards player
+	//             No -> Move towards player
+	//     No -> Have I moved in current direction for long enough?
+	//           Yes -> Flip direction
+	//           No -> Continue moving
 }
 
 
 
 
-bool AISystem::enemyFireProjectile(Entity& enemy, vec2 direction, float speedMultiplier, vec2 position) {
+ProjectileSpawn AISystem::enemyProjectileSpawn(Entity& enemy, vec2 direction, float speedMultiplier, vec2 position) {
 
 	// vec2 enemyPos = registry.positions.get(enemy).position;
 	vec2 vel;
@@ -317,8 +481,11 @@ bool AISystem::enemyFireProjectile(Entity& enemy, vec2 direction, float speedMul
 	ElementType elementType = registry.enemies.get(enemy).type;
 	if (elementType == ElementType::COMBO) elementType = getRandomElementType();
 
-	createProjectile(renderer, position, vel, elementType, true, enemy);
-	//															 ^^^^^ doesnt matter as ignored by the hostile = true
+	return { position, vel, elementType, true };
+}
+
+bool AISystem::enemyFireProjectile(Entity& enemy, vec2 direction, float speedMultiplier, vec2 position) {
+	projectile_pool.spawn(enemyProjectileSpawn(enemy, direction, speedMultiplier, position));
 	// Mix_PlayChannel(-1, projectile_sound, 0);
 	return true;
 }
@@ -333,4 +500,43 @@ bool AISystem::enemyFireProjectile(Entity& enemy, vec2 direction) {
 
 void AISystem::init(RenderSystem* renderer_arg) {
 	this->renderer = renderer_arg;
+
+	if (workers.empty()) {
+		size_t thread_count = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), AI_MAX_THREADS);
+		thread_actions.resize(thread_count);
+		for (size_t t = 1; t < thread_count; t++) {
+			workers.emplace_back(&AISystem::workerLoop, this, t);
+		}
+	}
+}
+
+AISystem::~AISystem() {
+	{
+		std::lock_guard<std::mutex> lock(work_mutex);
+		workers_quit = true;
+	}
+	work_condition.notify_all();
+	for (std::thread& worker : workers) worker.join();
+}
+
+// Sleeps until step hands out a frame's jobs, decides chunk t of them and reports back
+void AISystem::workerLoop(size_t t) {
+	size_t seen_generation = 0;
+	while (true) {
+		size_t begin, end;
+		{
+			std::unique_lock<std::mutex> lock(work_mutex);
+			work_condition.wait(lock, [&] { return workers_quit || work_generation != seen_generation; });
+			if (workers_quit) return;
+			seen_generation = work_generation;
+			begin = std::min(t * work_chunk, jobs.size());
+			end = std::min(begin + work_chunk, jobs.size());
+		}
+		for (size_t j = begin; j < end; j++) decideEnemy(jobs[j], thread_actions[t]);
+		{
+			std::lock_guard<std::mutex> lock(work_mutex);
+			workers_busy--;
+		}
+		done_condition.notify_one();
+	}
 }
\ No newline at end of file
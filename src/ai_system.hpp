@@ -1,23 +1,89 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "tiny_ecs_registry.hpp"
 #include "common.hpp"
 #include "render_system.hpp"
+#include "projectile_pool.hpp"
+#include "flow_field.hpp"
+#include "influence_map.hpp"
 
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 // DON'T WORRY ABOUT THIS CLASS UNTIL ASSIGNMENT 3
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
+// One thing an enemy decided to do, produced by the parallel decide pass and applied serially afterwards
+struct AIAction
+{
+	enum Type { STEER, FIRE, HEAL_ALLY };
+	Type type;
+	uint enemy_index;
+	vec2 vector; // new velocity for STEER, aim direction for FIRE and HEAL_ALLY
+};
+
+// An enemy scheduled to decide this frame
+struct AIJob
+{
+	uint index;
+	float elapsed_ms;
+	Enemy* enemy;
+	vec2 velocity;
+	bool is_boss;
+};
+
+// Everything the decide pass is allowed to look at, copied out of the registry once per frame
+struct AISnapshot
+{
+	vec2 player_position;
+	std::vector<vec2> enemy_positions; // indexed like registry.enemies
+	std::vector<float> enemy_health;
+	std::vector<ElementType> enemy_types;
+	std::unordered_map<unsigned int, uint> enemy_index; // entity id to index, for neighbours found in the influence map
+};
+
 class AISystem
 {
 public:
+	~AISystem();
 	void step(float elapsed_ms);
 	void init(RenderSystem* renderer);
 private:
+	void workerLoop(size_t t);
+	void addJob(uint i, AIUpdate& update);
+	void stepBoss(Entity entity_i, vec2 playerPos, float elapsed_ms);
+	void decideEnemy(const AIJob& job, std::vector<AIAction>& actions) const;
+	float sidePressure(vec2 position) const;
 	bool enemyFireProjectile(Entity& enemy, vec2 direction);
 	bool enemyFireProjectile(Entity& enemy, vec2 direction, float speedMultiplier);
 	bool enemyFireProjectile(Entity& enemy, vec2 direction, float speedMultiplier, vec2 position);
+	ProjectileSpawn enemyProjectileSpawn(Entity& enemy, vec2 direction, float speedMultiplier, vec2 position);
 	RenderSystem* renderer;
+
+	// navigation and tactics grids, rebuilt whenever a new level (and with it a new player) is loaded
+	FlowField flow_field;
+	Entity level_player;
+	InfluenceMap influence_map;
+
+	// indices of far away enemies due for an update this frame, kept around to reuse its allocation
+	std::vector<uint> far_enemies;
+	std::vector<AIJob> jobs;
+	AISnapshot snapshot;
+	std::vector<std::vector<AIAction>> thread_actions;
+
+	// Decide workers, started once in init. The simulation thread decides the first chunk itself,
+	// worker t-1 decides chunk t of every frame with enough jobs.
+	std::vector<std::thread> workers;
+	std::mutex work_mutex;
+	std::condition_variable work_condition; // a new frame's jobs are ready, or quit
+	std::condition_variable done_condition; // a worker finished its chunk
+	size_t work_generation = 0;             // bumped once per parallel frame
+	size_t work_chunk = 0;
+	size_t workers_busy = 0;
+	bool workers_quit = false;
+	float decide_cost_us = 10.f; // running average per enemy, turns the far update budget into an enemy count
 };
\ No newline at end of file
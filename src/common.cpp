@@ -1,5 +1,8 @@
 #include "common.hpp"
 
+// stlib
+#include <cstring>
+
 // Note, we could also use the functions from GLM but we write the transformations here to show the uderlying math
 void Transform::scale(vec2 scale)
 {
@@ -23,14 +26,14 @@ void Transform::translate(vec2 offset)
 
 void Camera::centerAt(vec2 pos)
 {
+	center = pos;
+
 	// Fake projection matrix, scales with respect to window coordinates
 	float left = pos.x - (float)window_width_px / 2;
 	float top = pos.y - (float)window_height_px / 2;
 	float right = pos.x + (float)window_width_px / 2;
 	float bottom = pos.y + (float)window_height_px / 2;
 
-	gl_has_errors();
-
 	float sx = 2.f / (right - left);
 	float sy = 2.f / (top - bottom);
 	float tx = -(right + left) / (right - left);
@@ -39,7 +42,22 @@ void Camera::centerAt(vec2 pos)
 	projectionMat = { {sx, 0.f, 0.f}, {0.f, sy, 0.f}, {tx, ty, 1.f} };
 }
 
-bool gl_has_errors()
+bool gl_has_extension(const char* extension)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (name != nullptr && strcmp(name, extension) == 0)
+			return true;
+	}
+	return false;
+}
+
+#ifndef NDEBUG
+std::atomic<bool> gl_error_checks(true);
+
+bool gl_check_errors()
 {
 	GLenum error = glGetError();
 
@@ -73,4 +91,5 @@ bool gl_has_errors()
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 // stlib
+#include <atomic>
 #include <fstream> // stdout, stderr..
 #include <string>
 #include <tuple>
@@ -62,7 +63,20 @@ struct Transform {
 
 struct Camera {
 	mat3 projectionMat;
+	vec2 center = { 0.f, 0.f }; // world position in the middle of the window
 	void centerAt(vec2 pos);
 };
 
-bool gl_has_errors();
+// whether the current context lists the extension
+bool gl_has_extension(const char* extension);
+
+// glGetError waits for the driver to catch up, so the checks sprinkled after GL calls only run while
+// gl_error_checks is set. It starts off when the debug output callback reports errors instead (see gl_debug.hpp),
+// F5 switches it at runtime. Release builds (NDEBUG) compile the checks away.
+#ifdef NDEBUG
+inline bool gl_has_errors() { return false; }
+#else
+extern std::atomic<bool> gl_error_checks;
+bool gl_check_errors();
+inline bool gl_has_errors() { return gl_error_checks.load(std::memory_order_relaxed) && gl_check_errors(); }
+#endif
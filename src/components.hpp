@@ -55,6 +55,11 @@ struct Boss {
 	Entity aura;
 };
 
+// AI level of detail, enemies far from the player make decisions less often and keep their last one in between
+struct AIUpdate {
+	float pending_ms = 0.f; // time since the last decision, handed to the next one as its elapsed time
+};
+
 // Obstacles
 struct Obstacle
 {
@@ -82,14 +87,6 @@ struct HealthPack
 	float value = 20;
 };
 
-// Shadow of the owner entity
-struct Shadow
-{
-	Entity owner;
-	bool active;
-	vec2 original_size;
-};
-
 // Exit door
 struct ExitDoor
 {
@@ -101,6 +98,9 @@ struct Text
 {
 	std::string text;
 	vec3 color;
+	// rgb and width, the width is a fraction of the glyph distance field spread (0.5 reaches the full spread)
+	vec4 outline = { 0.f, 0.f, 0.f, 0.f };
+	vec4 glow = { 0.f, 0.f, 0.f, 0.f };
 };
 
 // All data relevant to the resources of entities
@@ -159,7 +159,8 @@ struct Projectile
 	float damage = 10.f;
 	ElementType type;
 	bool hostile = false;
-	int bounces;
+	int bounces = 0;
+	bool active = true; // false while parked in the projectile pool
 };
 
 struct CharacterProjectileType
@@ -185,6 +186,17 @@ struct Floor {
 
 };
 
+// Marks a floor or wall whose quad was baked into a StaticGeometry batch, the entity itself isn't drawn anymore
+struct Baked {
+
+};
+
+// Static floors or walls of one texture, baked into world space vertices with their tiling when the level loads
+struct StaticGeometry {
+	int batch = -1; // index of the level's baked buffers
+	bool floor = false; // drawn in the floor layer, under everything else
+};
+
 
 // Data relevant to direction of entities
 typedef enum {
@@ -234,9 +246,36 @@ struct Collidable
 struct Debug {
 	bool in_debug_mode = 0;
 	bool in_freeze_mode = 0;
+	bool show_render_stats = 0;
+	bool dynamic_resolution = 1;
 };
 extern Debug debugging;
 
+// Entity lights up its surroundings, added onto the light buffer every frame
+struct LightSource
+{
+	float radius = 100.f;
+	vec3 color = { 1.f, 1.f, 1.f };
+	float intensity = 1.f;
+};
+
+// Shapes of particle bursts, see PARTICLE_EFFECTS in render_system_particles.cpp
+enum class PARTICLE_EFFECT {
+	TRAIL,
+	HIT_SPARK,
+	DEATH_BURST,
+	PARTICLE_EFFECT_COUNT
+};
+
+// Entity leaves a trail of particle bursts behind it. The particles live on the GPU only, see RenderSystem::emitParticles
+struct ParticleEmitter
+{
+	PARTICLE_EFFECT effect = PARTICLE_EFFECT::TRAIL;
+	vec3 color = { 1.f, 1.f, 1.f };
+	float interval_ms = 40.f; // between two bursts
+	float timer_ms = 0.f;
+};
+
 // Sets the brightness of the screen
 struct ScreenState
 {
@@ -283,13 +322,35 @@ struct ColoredVertex
 	vec3 color;
 };
 
-// Single Vertex Buffer element for textured sprites (textured.vs.glsl)
+// Single Vertex Buffer element for textured sprites (sprite_instanced.vs.glsl)
 struct TexturedVertex
 {
 	vec3 position;
 	vec2 texcoord;
 };
 
+// Single Vertex Buffer element for text (text_2d.vs.glsl), in window pixels
+struct TextVertex
+{
+	vec2 position;
+	vec2 texcoord;
+	vec3 color;
+	vec4 outline; // only read by text_2d_effects
+	vec4 glow;
+};
+
+// Glyph quads of a Text, laid out by the render system and only redone when what they were built from changes
+struct TextLayout
+{
+	std::string text;
+	vec2 position;
+	float scale;
+	vec3 color;
+	vec4 outline;
+	vec4 glow;
+	std::vector<TextVertex> vertices;
+};
+
 // Mesh datastructure for storing vertex and index buffers
 struct Mesh
 {
@@ -428,6 +489,11 @@ enum class EFFECT_ASSET_ID {
 	TEXT_2D,
 	ANIMATED,
 	SHADOW,
+	SPRITE_INSTANCED,
+	TEXT_2D_EFFECTS,
+	TILE_MAP,
+	LIGHT,
+	PARTICLE,
 	EFFECT_COUNT
 };
 const int effect_count = (int)EFFECT_ASSET_ID::EFFECT_COUNT;
@@ -499,6 +565,13 @@ struct RenderRequest {
 	GEOMETRY_BUFFER_ID used_geometry = GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
 };
 
+// Entity casts a shadow away from the light, the shadow itself is computed in shadow.vs.glsl
+struct CastsShadow
+{
+	TEXTURE_ASSET_ID texture;
+	GEOMETRY_BUFFER_ID geometry;
+};
+
 // One for each sprite sheet to indicate the states
 enum class POWER_UP_BLOCK_STATES {
 	ACTIVE,
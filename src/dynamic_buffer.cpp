@@ -0,0 +1,129 @@
+// internal
+#include "dynamic_buffer.hpp"
+
+// stlib
+#include <cstring>
+
+static bool hasBufferStorage()
+{
+	if (gl3wBufferStorage == nullptr)
+		return false;
+	return gl3w_is_supported(4, 4) || gl_has_extension("GL_ARB_buffer_storage");
+}
+
+void DynamicBuffer::init(GLenum target, size_t bytes_per_frame)
+{
+	this->target = target;
+	use_persistent = hasBufferStorage();
+	region = 0;
+	allocate(bytes_per_frame);
+}
+
+void DynamicBuffer::destroy()
+{
+	for (GLsync& fence : fences) {
+		if (fence != nullptr) glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (buffer != 0) {
+		if (mapped != nullptr) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	gl_has_errors();
+}
+
+void DynamicBuffer::allocate(size_t bytes_per_frame)
+{
+	// draws already submitted keep reading the old storage, GL only frees it once they are done
+	destroy();
+	region_size = bytes_per_frame;
+	const GLsizeiptr total = (GLsizeiptr)(region_size * DYNAMIC_BUFFER_FRAMES);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	if (use_persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, total, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(target, 0, total, flags);
+		if (mapped == nullptr) {
+			// immutable storage can't be respecified, start over with a plain buffer
+			fprintf(stderr, "Could not map the dynamic buffer persistently, falling back to glMapBufferRange\n");
+			glDeleteBuffers(1, &buffer);
+			use_persistent = false;
+			glGenBuffers(1, &buffer);
+			glBindBuffer(target, buffer);
+		}
+	}
+	if (!use_persistent) {
+		glBufferData(target, total, nullptr, GL_STREAM_DRAW);
+	}
+	cursor = region * region_size;
+	gl_has_errors();
+}
+
+void DynamicBuffer::beginFrame()
+{
+	region = (region + 1) % DYNAMIC_BUFFER_FRAMES;
+	GLsync& fence = fences[region];
+	if (fence != nullptr) {
+		// only blocks when the GPU is still DYNAMIC_BUFFER_FRAMES frames behind
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		while (status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(fence, 0, 1000000000);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	cursor = region * region_size;
+	gl_has_errors();
+}
+
+void DynamicBuffer::endFrame()
+{
+	GLsync& fence = fences[region];
+	if (fence != nullptr) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_has_errors();
+}
+
+size_t DynamicBuffer::write(const void* data, size_t bytes, size_t stride)
+{
+	size_t offset = (cursor + stride - 1) / stride * stride;
+	if (offset + bytes > (region + 1) * region_size) {
+		// too much for one region, the regions double until this frame fits
+		size_t grown = region_size > 0 ? region_size : stride;
+		while (grown < (offset - region * region_size) + bytes + stride) {
+			grown *= 2;
+		}
+		allocate(grown);
+		offset = (cursor + stride - 1) / stride * stride;
+	}
+	cursor = offset + bytes;
+
+	glBindBuffer(target, buffer);
+	if (bytes == 0)
+		return offset;
+
+	if (mapped != nullptr) {
+		memcpy(mapped + offset, data, bytes);
+	}
+	else {
+		// the fences keep the GPU off this range, so there's nothing to synchronize with
+		void* range = glMapBufferRange(target, (GLintptr)offset, (GLsizeiptr)bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (range != nullptr) {
+			memcpy(range, data, bytes);
+			glUnmapBuffer(target);
+		}
+		else {
+			glBufferSubData(target, (GLintptr)offset, (GLsizeiptr)bytes, data);
+		}
+	}
+	gl_has_errors();
+	return offset;
+}
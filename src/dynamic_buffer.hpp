@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.hpp"
+
+// frames the CPU may run ahead of the GPU, each gets its own region of the buffer
+const int DYNAMIC_BUFFER_FRAMES = 3;
+
+// Streaming buffer for vertex data that is rewritten every frame.
+// The buffer is split into one region per frame in flight. A frame only writes into its own region
+// and fences it when done, so by the time the region comes around again the GPU has finished reading it
+// and the writes never have to wait on the driver.
+// Writes go through a persistent mapping if the context has GL_ARB_buffer_storage,
+// through unsynchronized glMapBufferRange otherwise.
+class DynamicBuffer
+{
+public:
+	// bytes_per_frame is only a starting point, a region grows when a frame writes more
+	void init(GLenum target, size_t bytes_per_frame);
+	void destroy();
+
+	// call at the start of a frame, waits only if the GPU is DYNAMIC_BUFFER_FRAMES behind
+	void beginFrame();
+	// call once the frame's draws are submitted
+	void endFrame();
+
+	// Copies the data into this frame's region and returns its byte offset in the buffer.
+	// The offset is a multiple of stride, so it can also be used as the first vertex of a draw.
+	// The buffer is bound to its target afterwards, and its name can change when it grows.
+	size_t write(const void* data, size_t bytes, size_t stride);
+
+	GLuint handle() const { return buffer; }
+	bool persistent() const { return mapped != nullptr; }
+
+private:
+	void allocate(size_t bytes_per_frame);
+
+	GLenum target = GL_ARRAY_BUFFER;
+	GLuint buffer = 0;
+	size_t region_size = 0;
+	int region = 0;
+	size_t cursor = 0; // next free byte of the current region
+	GLsync fences[DYNAMIC_BUFFER_FRAMES] = {};
+	unsigned char* mapped = nullptr; // whole buffer if persistently mapped
+	bool use_persistent = false;
+};
@@ -0,0 +1,115 @@
+// internal
+#include "flow_field.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// stlib
+#include <algorithm>
+#include <cfloat>
+
+// 8-connected neighbourhood, straight steps first
+const int NEIGHBOUR_DX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+const int NEIGHBOUR_DY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+void FlowField::build()
+{
+	vec2 bounds_min = { FLT_MAX, FLT_MAX };
+	vec2 bounds_max = { -FLT_MAX, -FLT_MAX };
+	for (uint i = 0; i < registry.terrain.size(); i++) {
+		if (registry.terrain.components[i].moveable) continue;
+		const Position& position = registry.positions.get(registry.terrain.entities[i]);
+		vec2 half = abs(position.scale) / 2.f;
+		bounds_min = min(bounds_min, position.position - half);
+		bounds_max = max(bounds_max, position.position + half);
+	}
+	for (Entity entity : registry.players.entities) {
+		bounds_min = min(bounds_min, registry.positions.get(entity).position);
+		bounds_max = max(bounds_max, registry.positions.get(entity).position);
+	}
+
+	built = bounds_min.x <= bounds_max.x;
+	goal_cell = -1;
+	if (!built) return;
+
+	origin = bounds_min - FLOW_FIELD_CELL_SIZE;
+	cols = (int)ceil((bounds_max.x - origin.x) / FLOW_FIELD_CELL_SIZE) + 1;
+	rows = (int)ceil((bounds_max.y - origin.y) / FLOW_FIELD_CELL_SIZE) + 1;
+	blocked.assign(cols * rows, false);
+	directions.assign(cols * rows, vec2(0.f, 0.f));
+	steps.assign(cols * rows, -1);
+	frontier.reserve(cols * rows);
+
+	for (uint i = 0; i < registry.terrain.size(); i++) {
+		if (registry.terrain.components[i].moveable) continue;
+		const Position& position = registry.positions.get(registry.terrain.entities[i]);
+		vec2 half = abs(position.scale) / 2.f + FLOW_FIELD_TERRAIN_CLEARANCE;
+		int x0 = std::max(0, (int)floor((position.position.x - half.x - origin.x) / FLOW_FIELD_CELL_SIZE));
+		int y0 = std::max(0, (int)floor((position.position.y - half.y - origin.y) / FLOW_FIELD_CELL_SIZE));
+		int x1 = std::min(cols - 1, (int)floor((position.position.x + half.x - origin.x) / FLOW_FIELD_CELL_SIZE));
+		int y1 = std::min(rows - 1, (int)floor((position.position.y + half.y - origin.y) / FLOW_FIELD_CELL_SIZE));
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				blocked[y * cols + x] = true;
+			}
+		}
+	}
+}
+
+void FlowField::update(vec2 goal)
+{
+	if (!built) return;
+	int cell = cellIndex(goal);
+	if (cell == goal_cell) return;
+	recompute(cell);
+}
+
+vec2 FlowField::directionAt(vec2 position) const
+{
+	if (!built) return { 0.f, 0.f };
+	int cell = cellIndex(position);
+	if (cell < 0) return { 0.f, 0.f };
+	return directions[cell];
+}
+
+int FlowField::cellIndex(vec2 position) const
+{
+	int x = (int)floor((position.x - origin.x) / FLOW_FIELD_CELL_SIZE);
+	int y = (int)floor((position.y - origin.y) / FLOW_FIELD_CELL_SIZE);
+	if (x < 0 || y < 0 || x >= cols || y >= rows) return -1;
+	return y * cols + x;
+}
+
+void FlowField::recompute(int new_goal_cell)
+{
+	// only the cells reached by the previous search need to be cleared
+	for (int cell : frontier) {
+		steps[cell] = -1;
+		directions[cell] = vec2(0.f, 0.f);
+	}
+	frontier.clear();
+
+	goal_cell = new_goal_cell;
+	if (goal_cell < 0) return;
+
+	// breadth first search outwards from the goal, frontier doubles as the visited list
+	steps[goal_cell] = 0;
+	frontier.push_back(goal_cell);
+	for (size_t head = 0; head < frontier.size(); head++) {
+		int cell = frontier[head];
+		if (steps[cell] >= FLOW_FIELD_MAX_PATH_CELLS) continue;
+		int cx = cell % cols;
+		int cy = cell / cols;
+		for (int n = 0; n < 8; n++) {
+			int nx = cx + NEIGHBOUR_DX[n];
+			int ny = cy + NEIGHBOUR_DY[n];
+			if (nx < 0 || ny < 0 || nx >= cols || ny >= rows) continue;
+			int next = ny * cols + nx;
+			if (steps[next] >= 0 || blocked[next]) continue;
+			// no cutting corners past terrain on diagonal steps
+			if (n >= 4 && (blocked[cy * cols + nx] || blocked[ny * cols + cx])) continue;
+			steps[next] = steps[cell] + 1;
+			// point back towards the cell we were reached from
+			directions[next] = normalize(vec2(-NEIGHBOUR_DX[n], -NEIGHBOUR_DY[n]));
+			frontier.push_back(next);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+const float FLOW_FIELD_CELL_SIZE = 50.f;
+// terrain is grown by this much so enemies steer around corners instead of clipping them
+const float FLOW_FIELD_TERRAIN_CLEARANCE = 25.f;
+// cells further than this many steps from the goal are left without a direction
+const int FLOW_FIELD_MAX_PATH_CELLS = 32;
+
+// Navigation grid built from the static terrain of a level plus a flow field pointing towards a goal (the player).
+// The field is only rebuilt when the goal moves into a different cell, after that every enemy samples its
+// steering direction in O(1) instead of steering straight at the player and grinding along walls.
+class FlowField
+{
+public:
+	// rasterize all non-moving terrain into the grid and reset the field
+	void build();
+
+	// recompute the field if the goal changed cells, cheap to call every frame
+	void update(vec2 goal);
+
+	// normalized direction towards the goal, or zero if the position is unreachable, blocked or in the goal cell
+	vec2 directionAt(vec2 position) const;
+
+	bool isBuilt() const { return built; }
+
+private:
+	int cellIndex(vec2 position) const; // -1 if outside of the grid
+	void recompute(int goal_cell);
+
+	bool built = false;
+	vec2 origin = { 0.f, 0.f };
+	int cols = 0;
+	int rows = 0;
+	int goal_cell = -1;
+	std::vector<bool> blocked;
+	std::vector<vec2> directions;
+	std::vector<int> steps;        // BFS distance to the goal cell, -1 when unreached
+	std::vector<int> frontier;
+};
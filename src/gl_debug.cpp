@@ -0,0 +1,63 @@
+// internal
+#include "gl_debug.hpp"
+
+static const char* debugSourceName(GLenum source)
+{
+	switch (source) {
+	case GL_DEBUG_SOURCE_API: return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+static const char* debugTypeName(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "other";
+	}
+}
+
+static void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param)
+{
+	(void)length;
+	(void)user_param;
+	const char* severity_name = severity == GL_DEBUG_SEVERITY_HIGH ? "high" :
+		severity == GL_DEBUG_SEVERITY_MEDIUM ? "medium" : "low";
+	fprintf(stderr, "OpenGL %s %s (%s, id %u): %s\n", debugSourceName(source), debugTypeName(type), severity_name, id, message);
+	// output is synchronous in debug builds, so this stops right in the offending call
+	assert(type != GL_DEBUG_TYPE_ERROR);
+}
+
+bool initGlDebugOutput()
+{
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT) || gl3wDebugMessageCallback == nullptr ||
+		!(gl3w_is_supported(4, 3) || gl_has_extension("GL_KHR_debug"))) {
+		printf("No GL debug output, GL errors are checked with glGetError\n");
+		return false;
+	}
+
+	glEnable(GL_DEBUG_OUTPUT);
+#ifndef NDEBUG
+	// slower, but the callback runs inside the call that caused it
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+	glDebugMessageCallback(debugCallback, nullptr);
+	// buffer creation and the like are reported as notifications, only problems are worth printing
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glGetError(); // drop whatever was raised before the callback was installed
+
+#ifndef NDEBUG
+	gl_error_checks = false;
+#endif
+	return true;
+}
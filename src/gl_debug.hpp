@@ -0,0 +1,8 @@
+#pragma once
+
+#include "common.hpp"
+
+// Hands GL errors and warnings to a callback instead of polling glGetError, on contexts created with
+// GLFW_OPENGL_DEBUG_CONTEXT that have GL 4.3 or KHR_debug. The context has to be current.
+// Returns whether the callback is installed, gl_has_errors is switched off then.
+bool initGlDebugOutput();
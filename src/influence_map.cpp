@@ -0,0 +1,176 @@
+// internal
+#include "influence_map.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// stlib
+#include <algorithm>
+#include <cfloat>
+
+void InfluenceMap::build()
+{
+	vec2 bounds_min = { FLT_MAX, FLT_MAX };
+	vec2 bounds_max = { -FLT_MAX, -FLT_MAX };
+	for (uint i = 0; i < registry.terrain.size(); i++) {
+		const Position& position = registry.positions.get(registry.terrain.entities[i]);
+		vec2 half = abs(position.scale) / 2.f;
+		bounds_min = min(bounds_min, position.position - half);
+		bounds_max = max(bounds_max, position.position + half);
+	}
+	for (Entity entity : registry.players.entities) {
+		bounds_min = min(bounds_min, registry.positions.get(entity).position);
+		bounds_max = max(bounds_max, registry.positions.get(entity).position);
+	}
+	if (bounds_min.x > bounds_max.x) {
+		bounds_min = { 0.f, 0.f };
+		bounds_max = { (float)window_width_px, (float)window_height_px };
+	}
+
+	origin = bounds_min;
+	cols = (int)ceil((bounds_max.x - origin.x) / INFLUENCE_CELL_SIZE) + 1;
+	rows = (int)ceil((bounds_max.y - origin.y) / INFLUENCE_CELL_SIZE) + 1;
+
+	player_cell = -1;
+	player_threat.assign(cols * rows, 0.f);
+	projectile_count.assign(cols * rows, 0);
+	enemy_buckets.assign(cols * rows, std::vector<unsigned int>());
+	tracked_projectiles.clear();
+	tracked_enemies.clear();
+}
+
+int InfluenceMap::cellIndex(vec2 position) const
+{
+	int x = std::min(std::max((int)floor((position.x - origin.x) / INFLUENCE_CELL_SIZE), 0), cols - 1);
+	int y = std::min(std::max((int)floor((position.y - origin.y) / INFLUENCE_CELL_SIZE), 0), rows - 1);
+	return y * cols + x;
+}
+
+vec2 InfluenceMap::cellCenter(int cell) const
+{
+	return origin + (vec2((float)(cell % cols), (float)(cell / cols)) + 0.5f) * INFLUENCE_CELL_SIZE;
+}
+
+int InfluenceMap::neighbour(int cell, int dx, int dy) const
+{
+	int x = cell % cols + dx;
+	int y = cell / cols + dy;
+	if (x < 0 || y < 0 || x >= cols || y >= rows) return cell;
+	return y * cols + x;
+}
+
+void InfluenceMap::cellRange(vec2 position, float radius, int& x0, int& y0, int& x1, int& y1) const
+{
+	int low = cellIndex(position - radius);
+	int high = cellIndex(position + radius);
+	x0 = low % cols;
+	y0 = low / cols;
+	x1 = high % cols;
+	y1 = high / cols;
+}
+
+int InfluenceMap::projectilesAround(int cell, int rings, vec2& centroid) const
+{
+	int cx = cell % cols;
+	int cy = cell / cols;
+	int total = 0;
+	vec2 weighted = { 0.f, 0.f };
+	for (int y = std::max(cy - rings, 0); y <= std::min(cy + rings, rows - 1); y++) {
+		for (int x = std::max(cx - rings, 0); x <= std::min(cx + rings, cols - 1); x++) {
+			int count = projectile_count[y * cols + x];
+			total += count;
+			weighted += (float)count * cellCenter(y * cols + x);
+		}
+	}
+	if (total > 0) centroid = weighted / (float)total;
+	return total;
+}
+
+void InfluenceMap::stampPlayerThreat(int cell, float sign)
+{
+	int cx = cell % cols;
+	int cy = cell / cols;
+	int r = INFLUENCE_PLAYER_THREAT_RADIUS;
+	for (int y = std::max(cy - r, 0); y <= std::min(cy + r, rows - 1); y++) {
+		for (int x = std::max(cx - r, 0); x <= std::min(cx + r, cols - 1); x++) {
+			float d = length(vec2((float)(x - cx), (float)(y - cy)));
+			player_threat[y * cols + x] += sign * std::max(0.f, 1.f - d / (r + 1));
+		}
+	}
+}
+
+void InfluenceMap::updatePlayer(vec2 position)
+{
+	int cell = cellIndex(position);
+	if (cell == player_cell) return;
+	if (player_cell >= 0) stampPlayerThreat(player_cell, -1.f);
+	stampPlayerThreat(cell, 1.f);
+	player_cell = cell;
+}
+
+void InfluenceMap::updateProjectiles()
+{
+	frame++;
+	for (uint i = 0; i < registry.projectiles.size(); i++) {
+		const Projectile& projectile = registry.projectiles.components[i];
+		// only projectiles fired by the player are a threat to enemies
+		if (projectile.hostile || !projectile.active) continue;
+		Entity entity = registry.projectiles.entities[i];
+		int cell = cellIndex(registry.positions.get(entity).position);
+
+		auto it = tracked_projectiles.find(entity);
+		if (it == tracked_projectiles.end()) {
+			tracked_projectiles[entity] = { cell, frame };
+			projectile_count[cell]++;
+		} else {
+			if (it->second.cell != cell) {
+				projectile_count[it->second.cell]--;
+				projectile_count[cell]++;
+				it->second.cell = cell;
+			}
+			it->second.frame = frame;
+		}
+	}
+
+	// released into the pool (or gone with the level) since the last frame
+	for (auto it = tracked_projectiles.begin(); it != tracked_projectiles.end();) {
+		if (it->second.frame != frame) {
+			projectile_count[it->second.cell]--;
+			it = tracked_projectiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void InfluenceMap::updateEnemies()
+{
+	frame++;
+	for (uint i = 0; i < registry.enemies.size(); i++) {
+		Entity entity = registry.enemies.entities[i];
+		int cell = cellIndex(registry.positions.get(entity).position);
+
+		auto it = tracked_enemies.find(entity);
+		if (it == tracked_enemies.end()) {
+			tracked_enemies[entity] = { cell, frame };
+			enemy_buckets[cell].push_back(entity);
+		} else {
+			if (it->second.cell != cell) {
+				std::vector<unsigned int>& old_bucket = enemy_buckets[it->second.cell];
+				old_bucket.erase(std::find(old_bucket.begin(), old_bucket.end(), (unsigned int)entity));
+				enemy_buckets[cell].push_back(entity);
+				it->second.cell = cell;
+			}
+			it->second.frame = frame;
+		}
+	}
+
+	// killed since the last frame
+	for (auto it = tracked_enemies.begin(); it != tracked_enemies.end();) {
+		if (it->second.frame != frame) {
+			std::vector<unsigned int>& bucket = enemy_buckets[it->second.cell];
+			bucket.erase(std::find(bucket.begin(), bucket.end(), it->first));
+			it = tracked_enemies.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
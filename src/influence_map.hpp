@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+const float INFLUENCE_CELL_SIZE = 125.f;
+// cells around the player that feel its threat, fading out linearly
+const int INFLUENCE_PLAYER_THREAT_RADIUS = 3;
+
+// Coarse grid over the level that enemy AI reads its tactics from instead of scanning every other entity.
+// Layers:
+//  - player threat, restamped only when the player changes cells
+//  - player projectile density, counts per cell
+//  - enemy density, counts plus the enemies themselves per cell for neighbour queries
+// Projectiles and enemies are tracked by the cell they were last seen in, so a frame only touches the
+// cells of entities that crossed a cell border, appeared or disappeared.
+class InfluenceMap
+{
+public:
+	// size the grid to the level's terrain, call after a level was loaded
+	void build();
+
+	void updatePlayer(vec2 position);
+	void updateProjectiles();
+	void updateEnemies();
+
+	int cellIndex(vec2 position) const; // clamped onto the grid
+	vec2 cellCenter(int cell) const;
+	// cell one step from cell in the direction of offset, or cell itself at the border
+	int neighbour(int cell, int dx, int dy) const;
+
+	float playerThreat(int cell) const { return player_threat[cell]; }
+	int projectileDensity(int cell) const { return projectile_count[cell]; }
+	int enemyDensity(int cell) const { return (int)enemy_buckets[cell].size(); }
+
+	// sum of projectile counts over all cells at most rings cells away from cell, weighted position in centroid
+	int projectilesAround(int cell, int rings, vec2& centroid) const;
+
+	// calls visit(entity id) for every enemy tracked in a cell that overlaps the circle
+	template<typename Visit>
+	void forEachEnemyNear(vec2 position, float radius, Visit visit) const
+	{
+		int x0, y0, x1, y1;
+		cellRange(position, radius, x0, y0, x1, y1);
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				for (unsigned int id : enemy_buckets[y * cols + x]) visit(id);
+			}
+		}
+	}
+
+private:
+	struct Tracked
+	{
+		int cell;
+		unsigned int frame;
+	};
+
+	void cellRange(vec2 position, float radius, int& x0, int& y0, int& x1, int& y1) const;
+	void stampPlayerThreat(int cell, float sign);
+
+	vec2 origin = { 0.f, 0.f };
+	int cols = 1;
+	int rows = 1;
+	unsigned int frame = 0;
+
+	int player_cell = -1;
+	std::vector<float> player_threat = std::vector<float>(1, 0.f);
+	std::vector<int> projectile_count = std::vector<int>(1, 0);
+	std::vector<std::vector<unsigned int>> enemy_buckets = std::vector<std::vector<unsigned int>>(1);
+
+	std::unordered_map<unsigned int, Tracked> tracked_projectiles;
+	std::unordered_map<unsigned int, Tracked> tracked_enemies;
+};
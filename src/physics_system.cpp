@@ -1,6 +1,7 @@
 // internal
 #include "physics_system.hpp"
 #include "world_init.hpp"
+#include "projectile_pool.hpp"
 
 // Returns the local bounding coordinates scaled by the current size of the entity
 vec2 get_bounding_box(const Position& position)
@@ -128,48 +129,6 @@ bool shouldIgnoreCollision(Entity& entity_i, Entity& entity_j)
 	return false;
 }
 
-void updateShadows() {
-	Entity player_entity = registry.players.entities[0];
-	
-	Position& light_source_pos = (registry.lifeOrbs.entities.size() > 0)
-		? registry.positions.get(registry.lifeOrbs.entities[0])
-		: registry.positions.get(player_entity); //
-
-	for (uint i = 0; i < registry.shadows.entities.size(); i++) {
-		Entity entity = registry.shadows.entities[i];
-		Shadow& shadow = registry.shadows.get(entity);
-
-		Entity owner_entity = shadow.owner;
-
-		Position& shadow_pos = registry.positions.get(entity);
-		if (!registry.positions.has(owner_entity)) {
-			registry.remove_all_components_of(entity);
-			continue;
-		}
-		Position& owner_pos = registry.positions.get(owner_entity);
-		shadow.active = true;
-
-		if (distance((shadow_pos.position / vec2(window_width_px, window_height_px)), 
-			(light_source_pos.position / vec2(window_width_px, window_height_px))) > light_radius) {
-			shadow.active = false;
-		}
-
-		shadow_pos.position = owner_pos.position;
-
-		// M_PI / 2 is to make the shadow upright
-		shadow_pos.angle = atan2(owner_pos.position.y - light_source_pos.position.y, owner_pos.position.x - light_source_pos.position.x) + M_PI/2;
-
-		float max_dist = light_radius*std::max(window_width_px, window_height_px);
-
-		float dist = abs(distance(owner_pos.position, light_source_pos.position));
-		shadow_pos.scale = owner_pos.scale * (max_dist - dist) / max_dist;
-		shadow_pos.scale.y *= 1.5;
-
-		shadow_pos.position.x += cos(shadow_pos.angle - M_PI / 2) * (shadow_pos.scale.y / 2);
-		shadow_pos.position.y += owner_pos.scale.y / 2 + shadow_pos.scale.y / 2 * sin(shadow_pos.angle - M_PI/2);
-	}
-}
-
 void PhysicsSystem::step(float elapsed_ms)
 {
 	if (registry.deathTimers.entities.size() > 0) return;
@@ -186,15 +145,17 @@ void PhysicsSystem::step(float elapsed_ms)
 		position.position[1] += step_seconds * velocity.velocity[1];
 	}
 
-	// Update shadows
-	updateShadows();
-
 	// Check for collisions between things that are collidable
+	// projectiles parked in the pool are skipped up front so the pairwise loop never sees them
 	auto& collidables_container = registry.collidables;
-	for (uint i = 0; i < collidables_container.size(); i++) {
-		Entity& entity_i = collidables_container.entities[i];
-		for (uint j = i+1; j < collidables_container.size(); j++) {
-			Entity& entity_j = collidables_container.entities[j];
+	active_collidables.clear();
+	for (Entity entity : collidables_container.entities) {
+		if (!isInactiveProjectile(entity)) active_collidables.push_back(entity);
+	}
+	for (uint i = 0; i < active_collidables.size(); i++) {
+		Entity& entity_i = active_collidables[i];
+		for (uint j = i+1; j < active_collidables.size(); j++) {
+			Entity& entity_j = active_collidables[j];
 			// Ignore terrain-terrain and terrain-exitDoor collision
 			if (shouldIgnoreCollision(entity_i, entity_j)) continue;
 			// Broad phase of collision check
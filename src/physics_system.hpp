@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "common.hpp"
 #include "tiny_ecs.hpp"
 #include "components.hpp"
@@ -14,4 +16,7 @@ public:
 	PhysicsSystem()
 	{
 	}
+private:
+	// collidables that aren't parked in the projectile pool, kept around to reuse its allocation
+	std::vector<Entity> active_collidables;
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "projectile_pool.hpp"
+#include "tiny_ecs_registry.hpp"
+#include "world_init.hpp"
+
+// stlib
+#include <algorithm>
+
+ProjectilePool projectile_pool;
+
+// far outside of every level so parked projectiles never show up or collide
+const vec2 PROJECTILE_PARK_POSITION = { -100000.f, -100000.f };
+
+void ProjectilePool::init(RenderSystem* renderer_arg, Entity player_arg, uint level_arg, size_t capacity)
+{
+	// the entities of the previous level were already removed together with the rest of the registry
+	slots.clear();
+	free_slots.clear();
+	high_water_mark = 0;
+
+	this->renderer = renderer_arg;
+	this->player = player_arg;
+	this->level = level_arg;
+	grow(capacity);
+}
+
+void ProjectilePool::reportHighWaterMark() const
+{
+	if (slots.empty()) return; // no level was loaded yet
+	printf("Projectile pool high-water mark for level %u: %zu of %zu\n", level, high_water_mark, slots.size());
+}
+
+void ProjectilePool::grow(size_t count)
+{
+	slots.reserve(slots.size() + count);
+	free_slots.reserve(slots.size() + count);
+	for (size_t i = 0; i < count; i++) {
+		Entity entity = createProjectile(renderer, PROJECTILE_PARK_POSITION, vec2(0.f, 0.f), ElementType::WATER, true, player);
+		registry.projectiles.get(entity).active = false;
+		slots.push_back(entity);
+		free_slots.push_back(entity);
+	}
+}
+
+Entity ProjectilePool::spawn(const ProjectileSpawn& spawn)
+{
+	if (free_slots.empty()) grow(std::max(slots.size(), (size_t)1)); // double the pool
+
+	Entity entity = free_slots.back();
+	free_slots.pop_back();
+	resetProjectile(renderer, entity, spawn.position, spawn.velocity, spawn.type, spawn.hostile, player);
+
+	high_water_mark = std::max(high_water_mark, activeCount());
+	return entity;
+}
+
+void ProjectilePool::spawnBatch(const ProjectileSpawn* spawns, size_t count)
+{
+	if (free_slots.size() < count) grow(std::max(slots.size(), count - free_slots.size()));
+
+	for (size_t i = 0; i < count; i++) {
+		spawn(spawns[i]);
+	}
+}
+
+void ProjectilePool::release(Entity entity)
+{
+	Projectile& projectile = registry.projectiles.get(entity);
+	if (!projectile.active) return;
+
+	projectile.active = false;
+	registry.velocities.get(entity).velocity = vec2(0.f, 0.f);
+	Position& position = registry.positions.get(entity);
+	position.position = PROJECTILE_PARK_POSITION;
+	position.prev_position = PROJECTILE_PARK_POSITION;
+	free_slots.push_back(entity);
+}
+
+void ProjectilePool::releaseAll()
+{
+	for (Entity entity : slots) {
+		release(entity);
+	}
+}
+
+bool isInactiveProjectile(Entity entity)
+{
+	return registry.projectiles.has(entity) && !registry.projectiles.get(entity).active;
+}
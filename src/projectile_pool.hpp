@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+#include "components.hpp"
+#include "render_system.hpp"
+
+// Everything needed to (re)activate a pooled projectile
+struct ProjectileSpawn
+{
+	vec2 position;
+	vec2 velocity;
+	ElementType type;
+	bool hostile;
+};
+
+// Preallocated projectile entities that are recycled instead of being created and destroyed on every shot.
+// Released projectiles keep all of their components but are parked far outside the level with
+// Projectile::active = false, so firing and hitting things never inserts into or erases from the registry.
+// Any system iterating over projectiles must skip the inactive ones (see isInactiveProjectile).
+class ProjectilePool
+{
+public:
+	static const size_t DEFAULT_CAPACITY = 128;
+
+	// (Re)build the pool for a freshly loaded level, must be called after the registry was cleared
+	void init(RenderSystem* renderer, Entity player, uint level, size_t capacity = DEFAULT_CAPACITY);
+	// Print how many projectiles the level had in flight at most, call when the level ends
+	void reportHighWaterMark() const;
+
+	// Activate a free projectile, growing the pool if every slot is in use
+	Entity spawn(const ProjectileSpawn& spawn);
+	// Activate count projectiles at once, growing the pool at most once
+	void spawnBatch(const ProjectileSpawn* spawns, size_t count);
+
+	// Return a projectile to the pool, releasing an already inactive projectile does nothing
+	void release(Entity entity);
+	void releaseAll();
+
+	size_t capacity() const { return slots.size(); }
+	size_t activeCount() const { return slots.size() - free_slots.size(); }
+	size_t highWaterMark() const { return high_water_mark; }
+
+private:
+	void grow(size_t count);
+
+	RenderSystem* renderer = nullptr;
+	Entity player;
+	uint level = 0;
+	std::vector<Entity> slots;
+	std::vector<Entity> free_slots;
+	size_t high_water_mark = 0;
+};
+
+extern ProjectilePool projectile_pool;
+
+// true for projectile entities that are currently sitting unused in the pool
+bool isInactiveProjectile(Entity entity);
@@ -1,245 +1,347 @@
 // internal
 #include "render_system.hpp"
 #include <SDL.h>
+#include <algorithm>
 #include <iostream>
 
 #include "tiny_ecs_registry.hpp"
 
-void RenderSystem::drawTexturedMesh(Entity entity,
+void RenderSystem::useProgram(const ShaderProgram& program)
+{
+	if (bound_program == program.handle) return;
+	glUseProgram(program.handle);
+	bound_program = program.handle;
+	stats.program_changes++;
+}
+
+void RenderSystem::bindVertexArray(GEOMETRY_BUFFER_ID geometry)
+{
+	const GLuint vertex_array = vertex_arrays[(GLuint)geometry];
+	if (bound_vertex_array == vertex_array) return;
+	glBindVertexArray(vertex_array);
+	bound_vertex_array = vertex_array;
+}
+
+void RenderSystem::bindTexture(GLuint texture)
+{
+	if (bound_texture == texture) return;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	bound_texture = texture;
+	stats.texture_changes++;
+}
+
+void RenderSystem::drawTileMap(const mat3& projection)
+{
+	if (tile_map.empty())
+		return;
+
+	ShaderProgram& program = programs[(GLuint)EFFECT_ASSET_ID::TILE_MAP];
+	useProgram(program);
+	bindVertexArray(GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE);
+
+	// the lookup textures get their own units, unit 0 keeps what bindTexture thinks is bound
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, tile_chunk_table);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, tile_chunk_atlas);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, tile_palette);
+	glActiveTexture(GL_TEXTURE0);
+	bindTexture(texture_gl_handles[(GLuint)TEXTURE_ASSET_ID::FLOOR]);
+
+	program.sampler0.set(0);
+	program.chunk_table.set(1);
+	program.chunk_atlas.set(2);
+	program.tile_palette.set(3);
+	program.map_origin.set(tile_map.origin);
+	program.cell_size.set(tile_map.cell_size);
+	program.chunk_slots_per_row.set(tile_chunk_slots_per_row);
+	program.fcolor.set(vec3(1));
+	program.transform.set(inverse(projection));
+	gl_has_errors();
+
+	glDrawElements(GL_TRIANGLES, index_counts[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE], GL_UNSIGNED_SHORT, nullptr);
+	stats.draw_calls++;
+	gl_has_errors();
+}
+
+// The vertices are already in world space with their tiling, so this is one draw call per texture
+void RenderSystem::drawStaticGeometry(const RenderItem& item, const mat3& projection)
+{
+	assert(item.static_batch >= 0 && item.static_batch < (int)static_geometry_arrays.size());
+	const GLuint vertex_array = static_geometry_arrays[item.static_batch];
+
+	ShaderProgram& program = programs[(GLuint)EFFECT_ASSET_ID::SPRITE_INSTANCED];
+	useProgram(program);
+
+	if (bound_vertex_array != vertex_array) {
+		glBindVertexArray(vertex_array);
+		bound_vertex_array = vertex_array;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	bindTexture(texture_gl_handles[(GLuint)item.texture]);
+
+	// The batch has no instance arrays, so every vertex reads these constant instance attributes:
+	// no transform, no animation frame, untinted, the whole texture and no sprite mode
+	glVertexAttrib3f(ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE, 0.f, 0.f, 0.f);
+	glVertexAttrib2f(ATTRIBUTE_INSTANCE_SCALE, 1.f, 1.f);
+	glVertexAttrib4f(ATTRIBUTE_INSTANCE_FRAME, 0.f, 0.f, 0.f, 0.f);
+	glVertexAttrib4f(ATTRIBUTE_INSTANCE_COLOR, 1.f, 1.f, 1.f, 0.f);
+	glVertexAttrib4f(ATTRIBUTE_INSTANCE_UV_RECT, 0.f, 0.f, 1.f, 1.f);
+	glVertexAttrib4f(ATTRIBUTE_INSTANCE_PARAMS, 0.f, 0.f, 0.f, 0.f);
+	program.sampler0.set(0);
+	program.projection.set(projection);
+	gl_has_errors();
+
+	glDrawElements(GL_TRIANGLES, static_geometry_index_counts[item.static_batch], GL_UNSIGNED_SHORT, nullptr);
+	stats.draw_calls++;
+	gl_has_errors();
+}
+
+void RenderSystem::drawTexturedMesh(const RenderItem& item,
 	const mat3& projection)
 {
-	Position& position = registry.positions.get(entity);
 	// Transformation code, see Rendering and Transformation in the template
 	// specification for more info Incrementally updates transformation matrix,
 	// thus ORDER IS IMPORTANT
 	Transform transform;
-	transform.translate(position.position);
-	transform.rotate(position.angle);
-	transform.scale(position.scale);
-
-	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	transform.translate(vec2(item.sprite.translate_angle));
+	transform.rotate(item.sprite.translate_angle.z);
+	transform.scale(item.sprite.scale);
 
-	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
+	const GLuint used_effect_enum = (GLuint)item.effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
-	const GLuint program = (GLuint)effects[used_effect_enum];
+	ShaderProgram& program = programs[used_effect_enum];
 
 	// Setting shaders
-	glUseProgram(program);
+	useProgram(program);
 	gl_has_errors();
 
-	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	// The geometry's VAO holds its buffers and vertex layout
+	assert(item.geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
+	bindVertexArray(item.geometry);
 	gl_has_errors();
 
-	// Input data location as in the vertex buffer
-	if (render_request.used_effect == EFFECT_ASSET_ID::TEXTURED || 
-		render_request.used_effect == EFFECT_ASSET_ID::RESOURCE_BAR || 
-		render_request.used_effect == EFFECT_ASSET_ID::ANIMATED ||
-		render_request.used_effect == EFFECT_ASSET_ID::REPEAT)
+	// Textured, animated, repeat and resource bar sprites all go through batchSprite
+	if (item.effect == EFFECT_ASSET_ID::PLAYER || item.effect == EFFECT_ASSET_ID::EXIT_DOOR)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
-
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
-
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+		if (item.effect == EFFECT_ASSET_ID::PLAYER) {
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
-
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
-
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+			float time = (float) glfwGetTime();
+			vec3 initial_color = vec3(0.3f, 0.0f, 0.0f);
+			vec3 final_color = vec3(0.8f, 0.0f, 0.0f);
+			vec3 color_change = initial_color + (final_color - initial_color) * sin(time);
 
-		if (render_request.used_effect == EFFECT_ASSET_ID::RESOURCE_BAR) {
-			float fraction = 0.0;
-			float logoRatio = 0.0;
-			float barRatio = 1.0;
-			if (render_request.used_texture == TEXTURE_ASSET_ID::PLAYER_HEALTH_BAR || 
-				render_request.used_texture == TEXTURE_ASSET_ID::ENEMY_HEALTH_BAR || 
-				render_request.used_texture == TEXTURE_ASSET_ID::BOSS_HEALTH_BAR) {
-				assert(registry.healthBars.has(entity));
-				HealthBar& healthBar = registry.healthBars.get(entity);
-				assert(registry.resources.has(healthBar.owner));
-				Resources& resources = registry.resources.get(healthBar.owner);
-				fraction = resources.currentHealth / resources.maxHealth;
-				logoRatio = resources.logoRatio;
-				barRatio = resources.barRatio;
-			}
-			else if (render_request.used_texture == TEXTURE_ASSET_ID::PLAYER_MANA_BAR || render_request.used_texture == TEXTURE_ASSET_ID::ENEMY_MANA_BAR) {
-				assert(registry.manaBars.has(entity));
-				ManaBar& manaBar = registry.manaBars.get(entity);
-				assert(registry.resources.has(manaBar.owner));
-				Resources& resources = registry.resources.get(manaBar.owner);
-				fraction = resources.currentMana / resources.maxMana;
-				logoRatio = resources.logoRatio;
-				barRatio = resources.barRatio;
-			}
-			glUniform1f(glGetUniformLocation(program, "fraction"), fraction);
-			glUniform1f(glGetUniformLocation(program, "logoRatio"), logoRatio);
-			glUniform1f(glGetUniformLocation(program, "barRatio"), barRatio);
+			program.change.set(color_change);
 			gl_has_errors();
 		}
-		else if (render_request.used_effect == EFFECT_ASSET_ID::ANIMATED) {
-			assert(registry.animations.has(entity));
-			Animation& animation = registry.animations.get(entity);
-			assert(animation.sprite_sheet_ptr != nullptr);
-			glUniform1f(glGetUniformLocation(program, "time"), (float)(glfwGetTime() * 10.0f));
-			glUniform1i(glGetUniformLocation(program, "frame_col"), animation.getColumn());
-			glUniform1i(glGetUniformLocation(program, "frame_row"), animation.getRow());
-			glUniform1f(glGetUniformLocation(program, "frame_width"), animation.sprite_sheet_ptr->getFrameSizeInTexcoords().x);
-			glUniform1f(glGetUniformLocation(program, "frame_height"), animation.sprite_sheet_ptr->getFrameSizeInTexcoords().y);
-			glUniform1i(glGetUniformLocation(program, "rainbow_enabled"), animation.rainbow_enabled);
-			gl_has_errors();
-		}
-		else if (render_request.used_effect == EFFECT_ASSET_ID::REPEAT) {
-			float x_scale = 1;
-			float y_scale = 1;
-			if (registry.terrain.has(entity)) {
-				switch (registry.directions.get(entity).direction) {
-					case DIRECTION::N: // north
-					case DIRECTION::S: // south
-						x_scale = position.scale.x / 100;
-						break;
-					case DIRECTION::E: // side
-						y_scale = position.scale.y / 100;
-						break;
-					case DIRECTION::W: // generic
-						x_scale = position.scale.x / 100;
-						y_scale = position.scale.y / 100;
-					default:				
-						break;
-				}
-			}
-			else if (registry.floors.has(entity)) {
-				x_scale = position.scale.x / 100;
-				y_scale = position.scale.y / 100;
-			}
-			glUniform1f(glGetUniformLocation(program, "x_scale"), x_scale);
-			glUniform1f(glGetUniformLocation(program, "y_scale"), y_scale);
-		}
 	}
-	// This is kind of useless now
-	else if (render_request.used_effect == EFFECT_ASSET_ID::PLAYER || render_request.used_effect == EFFECT_ASSET_ID::EXIT_DOOR)
+	else
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_color_loc = glGetAttribLocation(program, "in_color");
-		gl_has_errors();
+		assert(false && "Type of render request not supported");
+	}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)0);
-		gl_has_errors();
+	program.fcolor.set(vec3(item.sprite.color));
+	gl_has_errors();
 
-		glEnableVertexAttribArray(in_color_loc);
-		glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)sizeof(vec3));
-		gl_has_errors();
+	GLsizei num_indices = index_counts[(GLuint)item.geometry];
 
-		if (render_request.used_effect == EFFECT_ASSET_ID::PLAYER) {
+	// Setting uniform values to the currently bound program
+	program.transform.set(transform.mat);
+	program.projection.set(projection);
+	gl_has_errors();
+	// Drawing of num_indices/3 triangles specified in the index buffer
+	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+	gl_has_errors();
+	stats.draw_calls++;
+}
 
-			float time = (float) glfwGetTime();
-			vec3 initial_color = vec3(0.3f, 0.0f, 0.0f);
-			vec3 final_color = vec3(0.8f, 0.0f, 0.0f);
-			vec3 color_change = initial_color + (final_color - initial_color) * sin(time);
+void RenderSystem::batchSprite(const RenderItem& item)
+{
+	SpriteInstance instance = item.sprite;
+	int mode = 0;
+	switch (item.effect) {
+	case EFFECT_ASSET_ID::ANIMATED:
+		// animations aren't tinted
+		instance.color = vec4(1.f);
+		if (item.sprite.color.a > 0.5f) mode |= SPRITE_MODE_RAINBOW;
+		break;
+	case EFFECT_ASSET_ID::REPEAT:
+		instance.frame = vec4(0.f);
+		instance.params = vec4(item.params.x, item.params.y, 0.f, 0.f);
+		mode |= SPRITE_MODE_REPEAT;
+		break;
+	case EFFECT_ASSET_ID::RESOURCE_BAR:
+		instance.frame = vec4(0.f);
+		instance.params = vec4(item.params, 0.f);
+		mode |= SPRITE_MODE_RESOURCE_BAR;
+		break;
+	default:
+		instance.frame = vec4(0.f);
+		break;
+	}
+	instance.color.a = (float)mode;
+	addSpriteInstance(EFFECT_ASSET_ID::SPRITE_INSTANCED, texture_gl_handles[(GLuint)item.texture], item.geometry, instance);
+}
 
-			GLuint change_uloc = glGetUniformLocation(program, "change");
-			glUniform3f(change_uloc, color_change.x, color_change.y, color_change.z);
-			gl_has_errors();
+// The shadow vertex shader derives the shadow from the owner's position and scale and the light
+void RenderSystem::batchShadow(const RenderItem& item)
+{
+	SpriteInstance instance = item.sprite;
+	instance.translate_angle.z = 0.f;
+	instance.frame = vec4(0.f);
+	instance.color = vec4(0.f);
+
+	addSpriteInstance(EFFECT_ASSET_ID::SHADOW, texture_gl_handles[(GLuint)item.texture], item.geometry, instance);
+}
+
+void RenderSystem::addSpriteInstance(EFFECT_ASSET_ID effect, GLuint texture, GEOMETRY_BUFFER_ID geometry, const SpriteInstance& instance)
+{
+	// all open batches draw with one program, shadows and sprites are in different layers so this rarely flushes
+	if (effect != sprite_batch_effect) {
+		flushSprites(sprite_batch_projection);
+		sprite_batch_effect = effect;
+	}
+
+	// only sprites between two unbatched draws (or layer changes) share batches, so the draw order relative to those is kept
+	for (size_t i = 0; i < open_sprite_batches; i++) {
+		SpriteBatch& batch = sprite_batches[i];
+		if (batch.texture == texture && batch.geometry == geometry) {
+			batch.instances.push_back(instance);
+			return;
 		}
 	}
-	else if (render_request.used_effect == EFFECT_ASSET_ID::SHADOW) {
-		if (!registry.shadows.get(entity).active) return;
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+	if (open_sprite_batches == sprite_batches.size())
+		sprite_batches.emplace_back();
+	SpriteBatch& batch = sprite_batches[open_sprite_batches++];
+	batch.texture = texture;
+	batch.geometry = geometry;
+	batch.instances.clear();
+	batch.instances.push_back(instance);
+}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
+void RenderSystem::flushSprites(const mat3& projection)
+{
+	if (open_sprite_batches == 0)
+		return;
+
+	// Pack every batch into one instance buffer, each batch draws from its own offset
+	sprite_instance_staging.clear();
+	for (size_t i = 0; i < open_sprite_batches; i++) {
+		const std::vector<SpriteInstance>& instances = sprite_batches[i].instances;
+		sprite_instance_staging.insert(sprite_instance_staging.end(), instances.begin(), instances.end());
+	}
+	const size_t buffer_offset = sprite_instance_buffer.write(sprite_instance_staging.data(),
+		sprite_instance_staging.size() * sizeof(SpriteInstance), sizeof(SpriteInstance));
+	gl_has_errors();
 
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+	ShaderProgram& program = programs[(GLuint)sprite_batch_effect];
+	useProgram(program);
+	program.projection.set(projection);
+	program.time.set((float)(glfwGetTime() * 10.0f));
+	program.sampler0.set(0);
+	// only read by the shadow pass
+	program.light_position.set(light_position);
+	program.light_radius.set(light_radius);
+	program.window_size.set(vec2(window_width_px, window_height_px));
+	glActiveTexture(GL_TEXTURE0);
+	gl_has_errors();
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
+	size_t first_instance = 0;
+	for (size_t i = 0; i < open_sprite_batches; i++) {
+		const SpriteBatch& batch = sprite_batches[i];
+
+		bindVertexArray(batch.geometry);
+
+		// Instance attributes advance once per sprite instead of once per vertex
+		glBindBuffer(GL_ARRAY_BUFFER, sprite_instance_buffer.handle());
+		const size_t base = buffer_offset + first_instance * sizeof(SpriteInstance);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, translate_angle)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE, 1);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_SCALE);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_SCALE, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, scale)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_SCALE, 1);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_FRAME);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_FRAME, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, frame)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_FRAME, 1);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_COLOR);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, color)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_COLOR, 1);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_UV_RECT);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_UV_RECT, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, uv_rect)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_UV_RECT, 1);
+		glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_PARAMS);
+		glVertexAttribPointer(ATTRIBUTE_INSTANCE_PARAMS, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(base + offsetof(SpriteInstance, params)));
+		glVertexAttribDivisor(ATTRIBUTE_INSTANCE_PARAMS, 1);
 		gl_has_errors();
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
+		bindTexture(batch.texture);
+		gl_has_errors();
 
-		glBindTexture(GL_TEXTURE_2D, texture_id);
+		glDrawElementsInstanced(GL_TRIANGLES, index_counts[(GLuint)batch.geometry], GL_UNSIGNED_SHORT, nullptr, (GLsizei)batch.instances.size());
 		gl_has_errors();
-	}
-	else
-	{
-		assert(false && "Type of render request not supported");
-	}
 
-	// Getting uniform locations for glUniform* calls
-	GLint color_uloc = glGetUniformLocation(program, "fcolor");
-	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
-	glUniform3fv(color_uloc, 1, (float*)&color);
-	gl_has_errors();
+		// The geometry's VAO is shared with the non instanced effects, which don't expect these arrays
+		for (GLuint loc = ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE; loc <= ATTRIBUTE_INSTANCE_UV_RECT; loc++) {
+			glDisableVertexAttribArray(loc);
+		}
+		glDisableVertexAttribArray(ATTRIBUTE_INSTANCE_PARAMS);
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+		first_instance += batch.instances.size();
+		stats.draw_calls++;
+		stats.sprite_batches++;
+		stats.batched_sprites += (int)batch.instances.size();
+	}
 	gl_has_errors();
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-	// GLsizei num_triangles = num_indices / 3;
+	open_sprite_batches = 0;
+}
 
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-	// Setting uniform values to the currently bound program
-	GLuint transform_loc = glGetUniformLocation(currProgram, "transform");
-	glUniformMatrix3fv(transform_loc, 1, GL_FALSE, (float*)&transform.mat);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "projection");
-	glUniformMatrix3fv(projection_loc, 1, GL_FALSE, (float*)&projection);
+void RenderSystem::drawLights(const RenderSnapshot& snapshot)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, light_frame_buffer);
+	glViewport(0, 0, light_buffer_size.x, light_buffer_size.y);
+	glClearColor(0, 0, 0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	// lights add up, overlapping lights get brighter
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
 	gl_has_errors();
-	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+
+	// The lantern around the camera: an ellipse over the screen that fades to LANTERN_EDGE_INTENSITY
+	SpriteInstance instance;
+	instance.translate_angle = vec3(snapshot.view.center, 0.f);
+	instance.scale = 2.f * snapshot.view.light_axes;
+	instance.frame = vec4(LANTERN_EDGE_INTENSITY, 0.f, 0.f, 0.f);
+	instance.color = vec4(1.f);
+	instance.uv_rect = vec4(0.f, 0.f, 1.f, 1.f);
+	addSpriteInstance(EFFECT_ASSET_ID::LIGHT, 0, GEOMETRY_BUFFER_ID::SPRITE, instance);
+	stats.lights++;
+
+	for (const SpriteInstance& light : snapshot.lights) {
+		addSpriteInstance(EFFECT_ASSET_ID::LIGHT, 0, GEOMETRY_BUFFER_ID::SPRITE, light);
+		stats.lights++;
+	}
+	flushSprites(sprite_batch_projection);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	gl_has_errors();
 }
 
-// draw the intermediate texture to the screen
-void RenderSystem::drawToScreen()
+void RenderSystem::drawToScreen(const RenderSnapshot& snapshot)
 {
+	drawLights(snapshot);
+
 	// Setting shaders
 	// get the lighting texture, sprite mesh, and program
-	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::DARKEN]);
+	ShaderProgram& darken_program = programs[(GLuint)EFFECT_ASSET_ID::DARKEN];
+	useProgram(darken_program);
 	gl_has_errors();
 	// Clearing backbuffer
-	int w, h;
-	glfwGetFramebufferSize(window, &w, &h); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, w, h);
+	glViewport(0, 0, snapshot.framebuffer_size.x, snapshot.framebuffer_size.y);
 	glDepthRange(0, 10);
 	glClearColor(1.f, 0, 0, 1.0);
 	glClearDepth(1.f);
@@ -251,41 +353,28 @@ void RenderSystem::drawToScreen()
 	glDisable(GL_DEPTH_TEST);
 
 	// Draw the screen texture on the quad geometry
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
-	glBindBuffer(
-		GL_ELEMENT_ARRAY_BUFFER,
-		index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]); // Note, GL_ELEMENT_ARRAY_BUFFER associates
-	// indices to the bound GL_ARRAY_BUFFER
+	bindVertexArray(GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE);
 	gl_has_errors();
-	const GLuint darken_program = effects[(GLuint)EFFECT_ASSET_ID::DARKEN];
-
-	// Pass light radius to the post-processing shader
-	glUniform1f(glGetUniformLocation(darken_program, "light_radius"), light_radius);
 
 	// Set clock
-	GLuint window_size_uloc = glGetUniformLocation(darken_program, "window_size");
-	GLuint dead_timer_uloc = glGetUniformLocation(darken_program, "screen_darken_factor");
-	GLuint radius_uloc = glGetUniformLocation(darken_program, "radius");
-	GLuint apply_spotlight_bool = glGetUniformLocation(darken_program, "apply_spotlight");
-	
-	ScreenState& screen = registry.screenStates.get(screen_state_entity);
-
-	glUniform2f(window_size_uloc, window_width_px, window_height_px);
-	glUniform1f(radius_uloc, screen.spotlight_radius);
-	glUniform1f(apply_spotlight_bool, screen.apply_spotlight);
-	glUniform1f(dead_timer_uloc, screen.screen_darken_factor);
-	gl_has_errors();
-	// Set the vertex position and vertex texture coordinates (both stored in the
-	// same VBO)
-	GLint in_position_loc = glGetAttribLocation(darken_program, "in_position");
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+	const ScreenState& screen = snapshot.screen;
+
+	darken_program.window_size.set(vec2(window_width_px, window_height_px));
+	darken_program.radius.set(screen.spotlight_radius);
+	darken_program.apply_spotlight.set((int)screen.apply_spotlight);
+	darken_program.screen_darken_factor.set(screen.screen_darken_factor);
+	darken_program.render_scale.set(vec2(render_scale));
 	gl_has_errors();
 
+	// The lights multiply the scene
+	darken_program.light_map.set(1);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, light_texture);
+
 	// Bind our texture in Texture Unit 0
 	glActiveTexture(GL_TEXTURE0);
 
-	glBindTexture(GL_TEXTURE_2D, off_screen_render_buffer_color);
+	bindTexture(off_screen_render_buffer_color);
 	gl_has_errors();
 	// Draw
 	glDrawElements(
@@ -293,118 +382,162 @@ void RenderSystem::drawToScreen()
 		nullptr); // one triangle = 3 vertices; nullptr indicates that there is
 	// no offset from the bound index buffer
 	gl_has_errors();
-}
-
-void RenderSystem::drawArsenal(Entity entity, const mat3& projection){
-	Position& position = registry.positions.get(entity);
-	Transform transform;
-	transform.translate(position.position);
-	transform.rotate(position.angle);
-	transform.scale(position.scale);
-
-	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
-
-	const GLuint program = (GLuint)effects[(GLuint)EFFECT_ASSET_ID::ANIMATED];
-
-	// Setting shaders
-	glUseProgram(program);
-	gl_has_errors();
+	stats.draw_calls++;
 
-	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	gl_has_errors();
-
-	GLint in_position_loc = glGetAttribLocation(program, "in_position");
-	GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
+	// the timer started in draw() covers the world and the upscale
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_timer_pending[gpu_timer_index] = true;
+	gpu_timer_index = (gpu_timer_index + 1) % GPU_TIMER_QUERY_COUNT;
 	gl_has_errors();
-	assert(in_texcoord_loc >= 0);
+}
 
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(TexturedVertex), (void*)0);
+void RenderSystem::updateRenderScale(bool dynamic_resolution)
+{
+	// collect whatever finished since the last frame, without waiting for the GPU
+	for (int i = 0; i < GPU_TIMER_QUERY_COUNT; i++) {
+		if (!gpu_timer_pending[i])
+			continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv(gpu_timer_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+		GLuint64 elapsed_ns = 0;
+		glGetQueryObjectui64v(gpu_timer_queries[i], GL_QUERY_RESULT, &elapsed_ns);
+		gpu_timer_pending[i] = false;
+		const float elapsed_ms = (float)elapsed_ns / 1000000.f;
+		gpu_frame_ms = gpu_frame_ms > 0.f ? mix(gpu_frame_ms, elapsed_ms, 0.1f) : elapsed_ms;
+	}
 	gl_has_errors();
 
-	glEnableVertexAttribArray(in_texcoord_loc);
-	glVertexAttribPointer(
-		in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-		(void*)sizeof(
-			vec3)); // note the stride to skip the preceeding vertex position
-
-	// Enabling and binding texture to slot 0
-	glActiveTexture(GL_TEXTURE0);
-	gl_has_errors();
+	if (!dynamic_resolution) {
+		render_scale = RENDER_SCALE_MAX;
+		render_scale_settle = 0;
+	}
+	else if (render_scale_settle > 0) {
+		render_scale_settle--;
+	}
+	else if (gpu_frame_ms > TARGET_FRAME_MS * RENDER_SCALE_SLOW && render_scale > RENDER_SCALE_MIN) {
+		render_scale = std::max(render_scale - RENDER_SCALE_STEP, RENDER_SCALE_MIN);
+		render_scale_settle = RENDER_SCALE_SETTLE_FRAMES;
+	}
+	else if (gpu_frame_ms > 0.f && gpu_frame_ms < TARGET_FRAME_MS * RENDER_SCALE_FAST && render_scale < RENDER_SCALE_MAX) {
+		render_scale = std::min(render_scale + RENDER_SCALE_STEP, RENDER_SCALE_MAX);
+		render_scale_settle = RENDER_SCALE_SETTLE_FRAMES;
+	}
 
-	assert(registry.renderRequests.has(entity));
-	GLuint texture_id =
-		texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
+	stats.render_scale = render_scale;
+	stats.gpu_ms = gpu_frame_ms;
+}
 
-	glBindTexture(GL_TEXTURE_2D, texture_id);
+// Only runs when a bar, the selected projectile or a power up changed
+void RenderSystem::renderHud(const RenderSnapshot& snapshot)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, hud_frame_buffer);
+	glViewport(0, 0, snapshot.framebuffer_size.x, snapshot.framebuffer_size.y);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+	// the texture ends up premultiplied, so drawHud blends it like the elements would have blended on their own
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 	gl_has_errors();
 
-	assert(registry.animations.has(entity));
-	Animation& animation = registry.animations.get(entity);
-	assert(animation.sprite_sheet_ptr != nullptr);
-	glUniform1f(glGetUniformLocation(program, "time"), (float)(glfwGetTime() * 10.0f));
-	glUniform1i(glGetUniformLocation(program, "frame_col"), animation.getColumn());
-	glUniform1i(glGetUniformLocation(program, "frame_row"), animation.getRow());
-	glUniform1f(glGetUniformLocation(program, "frame_width"), animation.sprite_sheet_ptr->getFrameSizeInTexcoords().x);
-	glUniform1f(glGetUniformLocation(program, "frame_height"), animation.sprite_sheet_ptr->getFrameSizeInTexcoords().y);
-	glUniform1i(glGetUniformLocation(program, "rainbow_enabled"), animation.rainbow_enabled);
-	gl_has_errors();
+	// the texture covers the window around the anchor, like the camera when it follows Aria
+	Camera camera;
+	camera.centerAt(vec2(0.f));
+	sprite_batch_projection = camera.projectionMat;
+	for (const RenderItem& item : snapshot.hud_items) {
+		batchSprite(item);
+	}
+	flushSprites(camera.projectionMat);
 
-	// Getting uniform locations for glUniform* calls
-	GLint color_uloc = glGetUniformLocation(program, "fcolor");
-	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
-	glUniform3fv(color_uloc, 1, (float*)&color);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	stats.hud_redraws++;
 	gl_has_errors();
+}
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+void RenderSystem::drawHud(const RenderSnapshot& snapshot)
+{
+	if (!snapshot.hud_visible)
+		return;
+
+	SpriteInstance instance;
+	instance.translate_angle = vec3(snapshot.hud_anchor, 0.f);
+	instance.scale = vec2(window_width_px, window_height_px);
+	instance.frame = vec4(0.f);
+	instance.color = vec4(1.f, 1.f, 1.f, 0.f); // untinted, no sprite mode
+	// render targets start at the bottom row, the sprite's texture coordinates at the top
+	instance.uv_rect = vec4(0.f, 1.f, 1.f, -1.f);
+
+	flushSprites(snapshot.projection);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	addSpriteInstance(EFFECT_ASSET_ID::SPRITE_INSTANCED, hud_texture, GEOMETRY_BUFFER_ID::SPRITE, instance);
+	flushSprites(snapshot.projection);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	gl_has_errors();
+}
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-	// GLsizei num_triangles = num_indices / 3;
-
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-	// Setting uniform values to the currently bound program
-	GLuint transform_loc = glGetUniformLocation(currProgram, "transform");
-	glUniformMatrix3fv(transform_loc, 1, GL_FALSE, (float*)&transform.mat);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "projection");
-	glUniformMatrix3fv(projection_loc, 1, GL_FALSE, (float*)&projection);
-	gl_has_errors();
-	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
-	gl_has_errors();
+void RenderSystem::drawImGui(RenderSnapshot& snapshot)
+{
+	ImGui_ImplOpenGL3_RenderDrawData(&snapshot.ui);
 }
 
-void RenderSystem::drawImGui()
+// Owns the GL context and draws every snapshot handed over by draw(), until the destructor stops it
+void RenderSystem::renderLoop()
 {
-	ImGui::Render();
-	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	glfwMakeContextCurrent(window);
+	while (true) {
+		std::unique_lock<std::mutex> lock(snapshot_mutex);
+		snapshot_condition.wait(lock, [this] { return snapshot_pending || render_thread_quit; });
+		if (!snapshot_pending)
+			break;
+		RenderSnapshot& snapshot = snapshots[1 - extract_snapshot];
+		lock.unlock();
+
+		renderSnapshot(snapshot);
+
+		lock.lock();
+		shown_stats = stats;
+		snapshot_pending = false;
+		lock.unlock();
+		snapshot_condition.notify_all();
+	}
+	glfwMakeContextCurrent(nullptr);
 }
 
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
-void RenderSystem::draw()
+void RenderSystem::renderSnapshot(RenderSnapshot& snapshot)
 {
 	// Getting size of window
-	int w, h;
-	glfwGetFramebufferSize(window, &w, &h); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
+	const int w = snapshot.framebuffer_size.x;
+	const int h = snapshot.framebuffer_size.y;
+
+	stats = snapshot.stats;
+	bound_program = 0;
+	bound_vertex_array = 0;
+	bound_texture = 0;
+	updateRenderScale(snapshot.dynamic_resolution);
+	sprite_instance_buffer.beginFrame();
+	text_vertex_buffer.beginFrame();
+
+	if (snapshot.level_changed)
+		uploadLevel(snapshot.level);
+	// outside of the timed world pass
+	if (snapshot.hud_changed)
+		renderHud(snapshot);
 
 	// First render to the custom framebuffer
 	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
 	gl_has_errors();
+	// a query still pending here is dropped, GL restarts it
+	gpu_timer_pending[gpu_timer_index] = false;
+	glBeginQuery(GL_TIME_ELAPSED, gpu_timer_queries[gpu_timer_index]);
+	gl_has_errors();
 
-	// Clearing backbuffer
-	glViewport(0, 0, w, h);
+	// Clearing backbuffer, the world only covers the render_scale corner of it
+	glViewport(0, 0, (GLsizei)(w * render_scale), (GLsizei)(h * render_scale));
 	glDepthRange(0.00001, 10);
 	glClearColor(0, 0, 0, 1.0);
 	glClearDepth(10.f);
@@ -416,168 +549,137 @@ void RenderSystem::draw()
 	// sprites back to front
 	gl_has_errors();
 
-	// get to players position
-	assert(registry.players.size() >= 1);
-	Entity entity = registry.players.entities[0];
-	Position& player_pos = registry.positions.get(entity);
-
-	// center the camera on the player (or life orb if specified)
-	Camera camera;
-	if (registry.lifeOrbs.size() > 0 && registry.lifeOrbs.components[0].centered_on_screen) {
-		camera.centerAt(registry.positions.get(registry.lifeOrbs.entities[0]).position);
+	light_position = snapshot.light_position;
+	sprite_batch_projection = snapshot.projection;
+
+	// the tile map floors are under everything else
+	drawTileMap(snapshot.projection);
+
+	// Commands come sorted by layer, the world layers go through the post processing pass before the HUD
+	bool world_finished = false;
+	RENDER_LAYER layer = RENDER_LAYER::FLOOR;
+	for (const RenderCommand& command : snapshot.commands) {
+		const RENDER_LAYER command_layer = (RENDER_LAYER)(command.key >> RENDER_KEY_LAYER_SHIFT);
+		if (command_layer != layer) {
+			flushSprites(snapshot.projection);
+			flushText();
+			if (!world_finished && command_layer >= FIRST_HUD_LAYER) {
+				// the particles are part of the world, they get lit with it
+				drawParticles(snapshot);
+				// Truely render to the screen
+				drawToScreen(snapshot);
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				drawHud(snapshot);
+				world_finished = true;
+			}
+			layer = command_layer;
+		}
+		submitRenderCommand(snapshot, command, snapshot.projection);
 	}
-	else {
-		camera.centerAt(player_pos.position);
+	flushSprites(snapshot.projection);
+	flushText();
+	if (!world_finished) {
+		drawParticles(snapshot);
+		drawToScreen(snapshot);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		drawHud(snapshot);
 	}
 
-	// Handle drawing floors first
-	for (Entity entity : registry.floors.entities) {
-		drawTexturedMesh(entity, camera.projectionMat);
-	}
+	// Render ImGui to screen
+	drawImGui(snapshot);
 
-	// Handle all shadows next
-	for (Entity entity : registry.shadows.entities) {
-		drawTexturedMesh(entity, camera.projectionMat);
-	}
+	// nothing else reads this frame's streamed vertices
+	sprite_instance_buffer.endFrame();
+	text_vertex_buffer.endFrame();
 
-	// Draw all textured meshes that have a position and size component
-	for (Entity entity : registry.renderRequests.entities)
-	{
-		if (!registry.positions.has(entity) || registry.texts.has(entity) || 
-			registry.shadows.has(entity) || registry.floors.has(entity) ||
-			registry.projectileSelectDisplays.has(entity) || registry.healthBars.has(entity) ||
-			registry.manaBars.has(entity) || registry.powerUpIndicators.has(entity))
-			continue;
-		// Note, its not very efficient to access elements indirectly via the entity
-		// albeit iterating through all Sprites in sequence. A good point to optimize
-		drawTexturedMesh(entity, camera.projectionMat);
-	}
-	
-	// Truely render to the screen
-	drawToScreen();
-
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	// flicker-free display with a double buffer
+	glfwSwapBuffers(window);
+	gl_has_errors();
+}
 
-	// We do this after post processing the lighting effect
-	if (registry.cutscenes.size() == 0) {
-		for (Entity entity : registry.healthBars.entities) {
-			drawTexturedMesh(entity, camera.projectionMat);
+void RenderSystem::submitRenderCommand(const RenderSnapshot& snapshot, const RenderCommand& command, const mat3& projection)
+{
+	const RenderItem& item = snapshot.items[command.item];
+	switch ((RENDER_LAYER)(command.key >> RENDER_KEY_LAYER_SHIFT)) {
+	case RENDER_LAYER::SHADOW:
+		batchShadow(item);
+		break;
+	case RENDER_LAYER::HUD_TEXT:
+		batchText(snapshot, item);
+		break;
+	default:
+		if (item.static_batch >= 0) {
+			flushSprites(projection);
+			drawStaticGeometry(item, projection);
+			break;
 		}
-
-		for (Entity entity : registry.manaBars.entities) {
-			drawTexturedMesh(entity, camera.projectionMat);
+		// Sprites are collected into instanced batches, anything else flushes them first to keep the draw order
+		if ((EFFECT_ASSET_ID)((command.key >> RENDER_KEY_PROGRAM_SHIFT) & 0x3F) == EFFECT_ASSET_ID::SPRITE_INSTANCED) {
+			batchSprite(item);
 		}
-	}
-
-	for (Entity entity : registry.texts.entities)
-	{
-		drawText(entity);
-	}
-
-	if (registry.cutscenes.size() == 0) {
-		for (Entity entity : registry.projectileSelectDisplays.entities) {
-			drawArsenal(entity, camera.projectionMat);
-
-			ProjectileSelectDisplay& selectDisplay = registry.projectileSelectDisplays.get(entity);
-			PowerUp& powerUp = registry.powerUps.components[0]; // lowkey unsafe
-
-			if (powerUp.fasterMovement) drawTexturedMesh(selectDisplay.fasterMovement, camera.projectionMat);
-			for (int i = 0; i < 4; i++) {
-				if (powerUp.increasedDamage[i]) drawTexturedMesh(selectDisplay.increasedDamage[i], camera.projectionMat);
-				if (powerUp.tripleShot[i]) drawTexturedMesh(selectDisplay.tripleShot[i], camera.projectionMat);
-				if (powerUp.bounceOffWalls[i]) drawTexturedMesh(selectDisplay.bounceOffWalls[i], camera.projectionMat);
-			}
+		else {
+			flushSprites(projection);
+			drawTexturedMesh(item, projection);
 		}
+		break;
 	}
-  
-	// Render ImGui to screen
-	drawImGui();
+}
 
-	// flicker-free display with a double buffer
-	glfwSwapBuffers(window);
-	gl_has_errors();
+void RenderSystem::batchText(const RenderSnapshot& snapshot, const RenderItem& item)
+{
+	// plain text and text with effects sort next to each other, so this flushes at most once per frame
+	if (item.effect != text_batch_effect) {
+		flushText();
+		text_batch_effect = item.effect;
+	}
+	const auto first = snapshot.text_vertices.begin() + item.first_text_vertex;
+	text_vertex_staging.insert(text_vertex_staging.end(), first, first + item.text_vertex_count);
 }
 
-void RenderSystem::drawText(Entity entity) {
+void RenderSystem::flushText()
+{
+	if (text_vertex_staging.empty())
+		return;
+
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	Position& position = registry.positions.get(entity);
-
-	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
 
-	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
-	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
-	const GLuint program = (GLuint)effects[used_effect_enum];
-
-	// Setting shaders
-	glUseProgram(program);
-	gl_has_errors();
-
-	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	gl_has_errors();
-
-	Text& text_component = registry.texts.get(entity);
-	float scale = position.scale.x;
-	std::string text = text_component.text;
-	vec3 color = text_component.color;
-	GLint vertex_loc = glGetAttribLocation(program, "vertex");
-	glEnableVertexAttribArray(vertex_loc);
-	glVertexAttribPointer(vertex_loc, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-
-	glUniform3f(glGetUniformLocation(program, "textColor"), color.x, color.y, color.z);
-	glActiveTexture(GL_TEXTURE0);
-	// iterate through all characters
-	std::string::const_iterator c;
-	float x = position.position.x;
-	float y = position.position.y;
-	for (c = text.begin(); c != text.end(); c++)
-	{
-		Character ch = Characters[*c];
-
-		float xpos = x + ch.Bearing.x * scale;
-		float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-		float w = ch.Size.x * scale;
-		float h = ch.Size.y * scale;
-
-		// update VBO for each character
-		float vertices[6][4] = {
-			{ xpos,     ypos + h,   0.0f, 0.0f },
-			{ xpos,     ypos,       0.0f, 1.0f },
-			{ xpos + w, ypos,       1.0f, 1.0f },
-
-			{ xpos,     ypos + h,   0.0f, 0.0f },
-			{ xpos + w, ypos,       1.0f, 1.0f },
-			{ xpos + w, ypos + h,   1.0f, 0.0f }
-		};
-		// render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-		// update content of VBO memory
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // be sure to use glBufferSubData and not glBufferData
-		// render quad
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		// now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-		x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
-	}
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
+	ShaderProgram& program = programs[(GLuint)text_batch_effect];
+	useProgram(program);
 	mat4 text_projection = ortho(0.0f, static_cast<float>(window_width_px), 0.0f, static_cast<float>(window_height_px));
-	glUniformMatrix4fv(glGetUniformLocation(currProgram, "projection"), 1, GL_FALSE, (float*)&text_projection);
+	program.projection.set(text_projection);
+	program.sampler0.set(0);
+	glActiveTexture(GL_TEXTURE0);
+	bindTexture(glyph_atlas);
+
+	const size_t buffer_offset = text_vertex_buffer.write(text_vertex_staging.data(),
+		text_vertex_staging.size() * sizeof(TextVertex), sizeof(TextVertex));
+
+	// the stream buffer can be replaced when it grows, so the layout is pointed at it on every flush
+	bindVertexArray(GEOMETRY_BUFFER_ID::TEXT_2D);
+	glBindBuffer(GL_ARRAY_BUFFER, text_vertex_buffer.handle());
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)0);
+	glEnableVertexAttribArray(ATTRIBUTE_COLOR);
+	glVertexAttribPointer(ATTRIBUTE_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, color));
+	glEnableVertexAttribArray(ATTRIBUTE_TEXT_OUTLINE);
+	glVertexAttribPointer(ATTRIBUTE_TEXT_OUTLINE, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, outline));
+	glEnableVertexAttribArray(ATTRIBUTE_TEXT_GLOW);
+	glVertexAttribPointer(ATTRIBUTE_TEXT_GLOW, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, glow));
+	glDrawArrays(GL_TRIANGLES, (GLint)(buffer_offset / sizeof(TextVertex)), (GLsizei)text_vertex_staging.size());
+	stats.draw_calls++;
+	stats.text_batches++;
 	gl_has_errors();
-	return;
+
+	text_vertex_staging.clear();
 }
 
 void RenderSystem::animation_step(float elapsed_ms)
 {
+	updateParticleEmitters(elapsed_ms);
+
 	elapsed_time += elapsed_ms;
 	if (elapsed_time > ANIMATION_SPEED) {
 		elapsed_time = 0.f;
@@ -1,21 +1,243 @@
 #pragma once
 
 #include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <utility>
 
 #include "common.hpp"
 
 #include "components.hpp"
+#include "dynamic_buffer.hpp"
+#include "shader_program.hpp"
+#include "tile_map.hpp"
 #include "tiny_ecs.hpp"
 
 // Holds all state information relevant to a character as loaded using FreeType
 struct Character {
-	GLuint TextureID;  // ID handle of the glyph texture
+	vec4   UVRect;    // (u0, v0, u1, v1) of the glyph in the glyph atlas
 	ivec2   Size;      // Size of glyph
 	ivec2   Bearing;   // Offset from baseline to left/top of glyph
 	unsigned int Advance;   // Horizontal offset to advance to next glyph
 };
 
+// Attribute locations bound to every program before linking, so a geometry's VAO works with any effect
+const GLuint ATTRIBUTE_POSITION = 0; // in_position, or the packed vertex of text_2d
+const GLuint ATTRIBUTE_TEXCOORD = 1;
+const GLuint ATTRIBUTE_COLOR = 2;
+// per instance data of sprite_instanced.vs.glsl
+const GLuint ATTRIBUTE_INSTANCE_TRANSLATE_ANGLE = 3;
+const GLuint ATTRIBUTE_INSTANCE_SCALE = 4;
+const GLuint ATTRIBUTE_INSTANCE_FRAME = 5;
+const GLuint ATTRIBUTE_INSTANCE_COLOR = 6;
+const GLuint ATTRIBUTE_INSTANCE_UV_RECT = 7;
+const GLuint ATTRIBUTE_INSTANCE_PARAMS = 10;
+// text effects of text_2d_effects.vs.glsl
+const GLuint ATTRIBUTE_TEXT_OUTLINE = 8;
+const GLuint ATTRIBUTE_TEXT_GLOW = 9;
+// per burst data of particle.vs.glsl, in its own VAO
+const GLuint ATTRIBUTE_PARTICLE_ORIGIN = 3;
+const GLuint ATTRIBUTE_PARTICLE_VELOCITY = 4;
+const GLuint ATTRIBUTE_PARTICLE_COLOR = 5;
+const GLuint ATTRIBUTE_PARTICLE_SHAPE = 6;
+
+// The light buffer is this many times smaller than the frame buffer on each side
+const int LIGHT_BUFFER_DOWNSCALE = 4;
+// the light carried around the camera (what screen_darken used to do on its own) keeps this much at its edge
+const float LANTERN_EDGE_INTENSITY = 0.1f;
+
+// Dynamic resolution: the world pass renders into a corner of the off-screen buffer this big (per side)
+// and drawToScreen stretches it over the window. The scale follows the measured GPU time of the world pass.
+const float RENDER_SCALE_MIN = 0.5f;
+const float RENDER_SCALE_MAX = 1.f;
+const float RENDER_SCALE_STEP = 0.05f;
+const float TARGET_FRAME_MS = 1000.f / 60.f;
+// the scale goes down above TARGET_FRAME_MS * RENDER_SCALE_SLOW and up below TARGET_FRAME_MS * RENDER_SCALE_FAST
+const float RENDER_SCALE_SLOW = 1.05f;
+const float RENDER_SCALE_FAST = 0.8f;
+// frames to wait after a change before judging the new scale
+const int RENDER_SCALE_SETTLE_FRAMES = 30;
+// timer queries in flight, results are read a few frames late so the CPU never waits on them
+const int GPU_TIMER_QUERY_COUNT = 3;
+
+// starting sizes of the streamed vertex data, the buffers grow if a frame needs more
+const size_t SPRITE_INSTANCES_PER_FRAME = 2048;
+const size_t TEXT_VERTICES_PER_FRAME = 8192;
+
+// Particle bursts of one effect alive at once, new ones are dropped while its ring is full
+const int MAX_PARTICLE_BURSTS_PER_EFFECT = 2048;
+const int PARTICLE_EFFECT_COUNT = (int)PARTICLE_EFFECT::PARTICLE_EFFECT_COUNT;
+// upper bound of PARTICLE_EFFECTS' counts
+const int MAX_PARTICLES_PER_BURST = 64;
+
+// Glyphs are rasterised once at this height as signed distance fields, any scale stays sharp
+const unsigned int FONT_PIXEL_SIZE = 48;
+
+// Per instance data of the sprite batcher, the layout must match the instance attributes of sprite_instanced.vs.glsl
+struct SpriteInstance {
+	vec3 translate_angle;
+	vec2 scale;
+	vec4 frame;  // column, row, width and height of the animation frame in texture coordinates
+	vec4 color;  // tint, alpha holds the SPRITE_MODE bits
+	vec4 uv_rect; // sub rectangle of the texture inside its atlas
+	vec4 params = vec4(0.f); // tiling scale with SPRITE_MODE_REPEAT, fraction, logo and bar ratio with SPRITE_MODE_RESOURCE_BAR
+};
+
+// What else sprite_instanced.vs.glsl does with an instance, so textured, animated, repeat and resource bar
+// sprites all share the program and its batches
+const int SPRITE_MODE_RAINBOW = 1;
+const int SPRITE_MODE_REPEAT = 2;
+const int SPRITE_MODE_RESOURCE_BAR = 4;
+
+// One emission of particles, the layout must match the attributes of particle.vs.glsl.
+// The vertex shader derives every particle from this and the time, nothing is simulated on the CPU.
+struct ParticleBurst {
+	vec4 origin_time; // position, emit time and lifetime in seconds
+	vec4 velocity;    // velocity of the emitter, speed of the particles and its random spread (px/s)
+	vec4 color;       // rgb, random seed
+	vec4 shape;       // particle count, start size, end size, drag
+};
+
+// A burst emitted since the last extraction and the slot of the particle buffer it goes into
+struct EmittedParticleBurst {
+	int slot;
+	ParticleBurst burst;
+};
+
+// All instances sharing a GL texture (usually an atlas) and geometry, drawn with a single instanced draw call
+struct SpriteBatch {
+	GLuint texture;
+	GEOMETRY_BUFFER_ID geometry;
+	std::vector<SpriteInstance> instances;
+};
+
+// Counters of the last rendered frame
+struct RenderStats {
+	int draw_calls = 0;
+	int sprite_batches = 0;
+	int text_batches = 0;
+	int text_layouts = 0; // texts that had to be laid out again this frame
+	int batched_sprites = 0;
+	int program_changes = 0;
+	int texture_changes = 0;
+	int lights = 0;
+	int visible_entities = 0; // world entities that passed culling
+	int culled_entities = 0;
+	float render_scale = 1.f;
+	float gpu_ms = 0.f; // smoothed GPU time of the world pass and the upscale
+	int hud_redraws = 0; // 1 if the cached HUD had to be drawn again
+	int particle_bursts = 0; // alive, each is one instance of the particle draw
+};
+
+// Part of the world that can end up on screen, see RenderSystem::updateViewBounds
+struct ViewBounds {
+	vec2 min;
+	vec2 max;
+	vec2 center;
+	vec2 light_axes;       // the lantern leaves everything outside this ellipse black
+	bool only_lantern;     // no other light on screen, so the lantern ellipse can cull
+	float spotlight_radius; // 0 when the spotlight isn't applied
+};
+
+// Draw order of the render queue, layers before FIRST_HUD_LAYER go through the post processing pass
+enum class RENDER_LAYER {
+	FLOOR,
+	SHADOW,
+	TERRAIN, // walls, static or moveable, everything in WORLD stands in front of them
+	WORLD,
+	HUD_BARS,
+	HUD_TEXT,
+	HUD_ARSENAL,
+	HUD_INDICATOR,
+	LAYER_COUNT
+};
+const RENDER_LAYER FIRST_HUD_LAYER = RENDER_LAYER::HUD_BARS;
+
+// One visible entity of the frame. The key packs, from the most significant bits down,
+// layer (4), program (6), texture (10), geometry (6) and depth (32), so sorting by key groups
+// draws by state while the depth (submission order) keeps equal states in their original order.
+// Within a layer the state wins over submission order, so whatever has to cover something else needs a later layer.
+struct RenderCommand {
+	uint64_t key;
+	uint32_t item; // index into RenderSnapshot::items
+};
+const int RENDER_KEY_LAYER_SHIFT = 60;
+const int RENDER_KEY_PROGRAM_SHIFT = 54;
+const int RENDER_KEY_TEXTURE_SHIFT = 44;
+const int RENDER_KEY_GEOMETRY_SHIFT = 38;
+
+// What the render thread needs to know of one queued entity, copied out of the registry
+struct RenderItem {
+	EFFECT_ASSET_ID effect;
+	TEXTURE_ASSET_ID texture;
+	GEOMETRY_BUFFER_ID geometry;
+	SpriteInstance sprite;  // transform, animation frame, colour (alpha > 0.5 enables the rainbow) and uv rect
+	vec3 params = vec3(0.f); // resource bar fraction, logo and bar ratio, or the repeat scale
+	int static_batch = -1;   // baked level buffers this item draws
+	uint32_t first_text_vertex = 0; // range of RenderSnapshot::text_vertices
+	uint32_t text_vertex_count = 0;
+};
+
+// Vertices of one baked batch, see RenderSystem::bakeStaticGeometry
+struct StaticBatch {
+	std::vector<TexturedVertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+// Level geometry built on the simulation thread, the render thread uploads it before drawing the next snapshot
+struct LevelGeometry {
+	TileMap tile_map;
+	std::vector<StaticBatch> batches;
+};
+
+// Draw the snapshots on a thread that owns the GL context, the simulation thread then only copies the frame
+// out of the registry. Off draws them right away on the simulation thread (simpler to debug).
+const bool RENDER_ON_THREAD = true;
+
+// Everything one frame draws. The simulation thread fills one snapshot while the render thread draws the other,
+// so the render thread never reads the registry.
+struct RenderSnapshot {
+	std::vector<RenderCommand> commands; // sorted
+	std::vector<RenderItem> items;
+	std::vector<TextVertex> text_vertices;
+	std::vector<SpriteInstance> lights; // visible LightSources, the lantern follows view
+	ViewBounds view;
+	mat3 projection;
+	vec2 light_position;
+	ivec2 framebuffer_size;
+	ScreenState screen;
+	bool dynamic_resolution;
+	RenderStats stats; // counters of the extraction, the render thread adds its own
+
+	bool level_changed = false;
+	LevelGeometry level;
+
+	// Aria's own HUD, cached in a texture and composited around hud_anchor, see RenderSystem::extractHud.
+	// hud_items (positioned relative to the anchor) only come along when the cache has to be drawn again.
+	bool hud_visible = false;
+	bool hud_changed = false;
+	vec2 hud_anchor;
+	std::vector<RenderItem> hud_items;
+
+	// Every effect has its own ring in the particle buffer, its live bursts are the particle_count slots
+	// of the ring from particle_first on (wrapping around). New bursts are sorted by slot.
+	std::vector<EmittedParticleBurst> new_particle_bursts;
+	std::array<int, PARTICLE_EFFECT_COUNT> particle_first = {};
+	std::array<int, PARTICLE_EFFECT_COUNT> particle_count = {};
+	float particle_time = 0.f;
+
+	// ImGui reuses its draw lists on the next NewFrame, so the snapshot keeps clones
+	ImDrawData ui;
+	void copyUi(const ImDrawData* draw_data);
+	void clearUi();
+
+	RenderSnapshot() = default;
+	RenderSnapshot(const RenderSnapshot&) = delete;
+	RenderSnapshot& operator=(const RenderSnapshot&) = delete;
+	~RenderSnapshot() { clearUi(); }
+};
+
 // System responsible for setting up OpenGL and for rendering all the
 // visual entities in the game
 class RenderSystem {
@@ -28,6 +250,8 @@ class RenderSystem {
 	 */
 	std::array<GLuint, texture_count> texture_gl_handles;
 	std::array<ivec2, texture_count> texture_dimensions;
+	// Sub rectangle (offset, size) of every texture inside its GL texture, most textures share an atlas
+	std::array<vec4, texture_count> texture_uv_rects;
 
 	// Make sure these paths remain in sync with the associated enumerators.
 	// Associated id with .obj path
@@ -90,29 +314,40 @@ class RenderSystem {
 	};
 
 	std::array<GLuint, effect_count> effects;
+	// Reflected locations of every effect, the draw code goes through these instead of querying GL by name
+	std::array<ShaderProgram, effect_count> programs;
 	// Make sure these paths remain in sync with the associated enumerators.
 	const std::array<std::string, effect_count> effect_paths = {
 		shader_path("aria"),
 		shader_path("coloured"),
 		shader_path("salmon"),
-		shader_path("textured"),
+		"", // TEXTURED, ANIMATED, REPEAT and RESOURCE_BAR only pick a sprite mode, sprite_instanced draws them
 		shader_path("screen_darken"),
-		shader_path("repeat"),
+		"",
 		shader_path("exit_door"),
-		shader_path("resource_bar"),
+		"",
 		shader_path("text_2d"),
-		shader_path("animated"),
-		shader_path("shadow")
+		"",
+		shader_path("shadow"),
+		shader_path("sprite_instanced"),
+		shader_path("text_2d_effects"),
+		shader_path("tile_map"),
+		shader_path("light"),
+		shader_path("particle")
 	};
 
 	std::array<GLuint, geometry_count> vertex_buffers;
 	std::array<GLuint, geometry_count> index_buffers;
+	// One VAO per geometry with its buffers and vertex layout, plus the number of uint16_t indices to draw
+	std::array<GLuint, geometry_count> vertex_arrays;
+	std::array<GLsizei, geometry_count> index_counts;
 	std::array<Mesh, geometry_count> meshes;
 
 	std::array<SpriteSheet, sprite_sheet_count> sprite_sheets;
 
-	GLuint vao;
 	std::unordered_map<GLchar, Character> Characters;
+	// distance fields of every glyph of the font in one GL_RED texture
+	GLuint glyph_atlas = 0;
 
 public:
 	// Initialize the window
@@ -136,26 +371,105 @@ public:
 	// The draw loop first renders to this texture, then it is used for the water
 	// shader
 	bool initScreenTexture();
+	// Quarter resolution target the lights are added up in
+	void initLightBuffer();
+	// Timer queries of the dynamic resolution
+	void initGpuTimers();
+	// Target the cached HUD is drawn into
+	void initHudBuffer();
+	// Ring buffers of the particle bursts
+	void initParticles();
 
 	void initializeFreeType();
 
 	void initializeImGui();
 
+	// Puts the level's floors into the tile map and merges the quads of the non moveable walls
+	// (and any floor the tile map can't take) into one vertex buffer per texture,
+	// call once the level's entities exist. The buffers are uploaded with the next snapshot.
+	void bakeStaticGeometry();
+
 	// Destroy resources associated to one or all entities created by the system
 	~RenderSystem();
 
-	// Draw all entities
+	// Copies the visible entities into a snapshot and hands it to the render thread,
+	// waits only while the render thread is still drawing the previous one
 	void draw();
 
 	void animation_step(float elapsed_ms);
 
+	// Starts a burst of particles, they move and fade out on the GPU without any entities
+	void emitParticles(PARTICLE_EFFECT effect, vec2 position, vec3 color, vec2 velocity = vec2(0.f));
+
+	// counters of the last frame the render thread finished
+	RenderStats getRenderStats();
+
 private:
+	// Extraction, on the simulation thread (render_system_extract.cpp)
+	void extractSnapshot(RenderSnapshot& snapshot);
+	bool isLightVisible(Entity entity) const;
+	const TextLayout& layoutText(Entity entity, RenderStats& extract_stats);
+	// texture coordinate scale of the repeat effect, so floors and walls tile every 100 px
+	vec2 repeatScale(Entity entity) const;
+	RenderItem extractRenderItem(Entity entity, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geometry) const;
+	// HUD elements that follow Aria go into the cached HUD, the rest (enemy bars) is queued like the world
+	void queueHudCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity);
+	// compares the frame's cached HUD elements with what the cache holds
+	void extractHud(RenderSnapshot& snapshot);
+	// Particles, on the simulation thread (render_system_particles.cpp)
+	void updateParticleEmitters(float elapsed_ms);
+	void extractParticles(RenderSnapshot& snapshot);
+
+	// Render queue, rebuilt and sorted every frame
+	void queueRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity);
+	void queueRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geometry);
+	void pushRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, EFFECT_ASSET_ID key_effect, const RenderItem& item);
+	void collectRenderCommands(RenderSnapshot& snapshot);
+	void updateViewBounds(const Camera& camera);
+	bool isVisible(Entity entity, float margin = 0.f);
+	void sortRenderCommands(std::vector<RenderCommand>& commands);
+
+	// Drawing, on the thread that owns the GL context
+	void renderLoop();
+	void renderSnapshot(RenderSnapshot& snapshot);
+	void uploadLevel(LevelGeometry& level);
+	void submitRenderCommand(const RenderSnapshot& snapshot, const RenderCommand& command, const mat3& projection);
+
 	// Internal drawing functions for each entity type
-	void drawTexturedMesh(Entity entity, const mat3& projection);
-	void drawToScreen();
-	void drawText(Entity entity);
-	void drawImGui();
-	void drawArsenal(Entity entity, const mat3& projection);
+	void drawTexturedMesh(const RenderItem& item, const mat3& projection);
+	void drawToScreen(const RenderSnapshot& snapshot);
+	// Reads back finished timer queries and moves render_scale towards TARGET_FRAME_MS
+	void updateRenderScale(bool dynamic_resolution);
+	// Adds every visible light onto the light buffer, one instanced draw call
+	void drawLights(const RenderSnapshot& snapshot);
+	// Queues the glyph quads of a text, all texts queued since the last flush are one draw call
+	void batchText(const RenderSnapshot& snapshot, const RenderItem& item);
+	void flushText();
+	void drawImGui(RenderSnapshot& snapshot);
+	// draws the snapshot's hud_items into the HUD texture
+	void renderHud(const RenderSnapshot& snapshot);
+	// the cached HUD as one quad, under the rest of the HUD
+	void drawHud(const RenderSnapshot& snapshot);
+	// uploads the new bursts and draws the live ones over the world, at most two instanced draw calls per effect
+	void drawParticles(const RenderSnapshot& snapshot);
+	void uploadParticleBursts(const RenderSnapshot& snapshot);
+	void drawStaticGeometry(const RenderItem& item, const mat3& projection);
+	// all floors of the tile map in one full screen pass
+	void drawTileMap(const mat3& projection);
+	void uploadTileMap();
+
+	// GL binds that are skipped when the object is already bound
+	void useProgram(const ShaderProgram& program);
+	void bindVertexArray(GEOMETRY_BUFFER_ID geometry);
+	void bindTexture(GLuint texture);
+
+	// Sprite batching for TEXTURED, ANIMATED, REPEAT and RESOURCE_BAR render requests
+	void batchSprite(const RenderItem& item);
+	// Shadows of CastsShadow entities go through the same batches, drawn with the shadow program
+	void batchShadow(const RenderItem& item);
+	void addSpriteInstance(EFFECT_ASSET_ID effect, GLuint texture, GEOMETRY_BUFFER_ID geometry, const SpriteInstance& instance);
+	// Draws every batch collected since the last flush, one instanced draw call per texture and geometry
+	void flushSprites(const mat3& projection);
 
 	// Helper functions for initializeSpriteSheets()
 	void initializePowerUpBlockSpriteSheet();
@@ -187,12 +501,86 @@ private:
 	GLuint frame_buffer;
 	GLuint off_screen_render_buffer_color;
 	GLuint off_screen_render_buffer_depth;
+	GLuint light_frame_buffer;
+	GLuint light_texture;
+	ivec2 light_buffer_size;
+	GLuint hud_frame_buffer;
+	GLuint hud_texture;
+
+	// dynamic resolution
+	float render_scale = RENDER_SCALE_MAX;
+	std::array<GLuint, GPU_TIMER_QUERY_COUNT> gpu_timer_queries;
+	std::array<bool, GPU_TIMER_QUERY_COUNT> gpu_timer_pending;
+	int gpu_timer_index = 0;
+	float gpu_frame_ms = 0.f;
+	int render_scale_settle = 0;
 
 	Entity screen_state_entity;
 
+	DynamicBuffer sprite_instance_buffer;
+	std::vector<SpriteBatch> sprite_batches;
+	size_t open_sprite_batches = 0; // batches in use since the last flush, the rest keep their allocations
+	std::vector<SpriteInstance> sprite_instance_staging;
+	EFFECT_ASSET_ID sprite_batch_effect = EFFECT_ASSET_ID::SPRITE_INSTANCED; // program of the open batches
+	mat3 sprite_batch_projection;
+	vec2 light_position; // where shadows fall away from
+
+	std::vector<TextVertex> text_vertex_staging;
+	DynamicBuffer text_vertex_buffer;
+	EFFECT_ASSET_ID text_batch_effect = EFFECT_ASSET_ID::TEXT_2D;
+
+	// buffers of the baked level, the StaticGeometry entities are removed with the level but these are kept until the next bake
+	std::vector<GLuint> static_geometry_buffers;
+	std::vector<GLuint> static_geometry_arrays;
+	std::vector<GLsizei> static_geometry_index_counts;
+	// baked on the simulation thread, waiting for the next extraction
+	LevelGeometry pending_level;
+	bool pending_level_changed = false;
+
+	TileMap tile_map;
+	GLuint tile_chunk_table = 0;
+	GLuint tile_chunk_atlas = 0;
+	GLuint tile_palette = 0;
+	int tile_chunk_slots_per_row = 1;
+
+	ViewBounds view_bounds;
+	std::vector<RenderCommand> render_commands_scratch;
+	// cached HUD elements of the frame being extracted, and those the HUD texture was last drawn from
+	std::vector<RenderItem> hud_items_scratch;
+	std::vector<RenderItem> cached_hud_items;
+
+	// Particle bursts as the simulation thread sees them, the GL buffer is written by the render thread
+	float particle_time = 0.f; // seconds, the clock of the particle shader
+	std::vector<EmittedParticleBurst> emitted_particle_bursts; // since the last extraction
+	// One ring per effect, an effect's bursts all live equally long, so they also die in the order they were emitted
+	struct ParticleRing {
+		std::array<float, MAX_PARTICLE_BURSTS_PER_EFFECT> expiry; // particle_time each slot dies at
+		int next = 0;  // slot of the next burst
+		int count = 0; // live slots, ending right before next
+	};
+	std::array<ParticleRing, PARTICLE_EFFECT_COUNT> particle_rings;
+	float particle_seed = 0.f;
+	GLuint particle_buffer = 0;
+	GLuint particle_vertex_array = 0;
+
+	// Render thread, see RENDER_ON_THREAD
+	std::thread render_thread;
+	std::mutex snapshot_mutex;
+	std::condition_variable snapshot_condition;
+	std::array<RenderSnapshot, 2> snapshots;
+	int extract_snapshot = 0;      // filled by the simulation thread, the other one belongs to the render thread
+	bool snapshot_pending = false; // the render thread's snapshot is waiting to be drawn or being drawn
+	bool render_thread_quit = false;
+	RenderStats shown_stats;       // of the last drawn snapshot, guarded by snapshot_mutex
+
+	// last bound objects, reset every frame since ImGui binds its own
+	GLuint bound_program = 0;
+	GLuint bound_vertex_array = 0;
+	GLuint bound_texture = 0;
+
+	RenderStats stats; // of the frame being drawn
+
 	float elapsed_time = 0.f;
 	const float ANIMATION_SPEED = 100.f;
 };
 
-bool loadEffectFromFile(
-	const std::string& vs_path, const std::string& fs_path, GLuint& out_program);
@@ -0,0 +1,515 @@
+// internal
+#include "render_system.hpp"
+
+#include "tiny_ecs_registry.hpp"
+#include "projectile_pool.hpp"
+
+// stlib
+#include <algorithm>
+
+static_assert(effect_count <= 64 && geometry_count <= 64, "render keys reserve 6 bits for programs and geometries");
+
+// Render requests the sprite batcher can draw, sprite_instanced.vs.glsl covers each of these effects with its mode bits
+static bool isBatchable(EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture)
+{
+	return (effect == EFFECT_ASSET_ID::TEXTURED || effect == EFFECT_ASSET_ID::ANIMATED ||
+		effect == EFFECT_ASSET_ID::REPEAT || effect == EFFECT_ASSET_ID::RESOURCE_BAR) &&
+		texture != TEXTURE_ASSET_ID::TEXTURE_COUNT;
+}
+
+void RenderSnapshot::copyUi(const ImDrawData* draw_data)
+{
+	clearUi();
+	ui = *draw_data;
+	for (int i = 0; i < ui.CmdListsCount; i++) {
+		ui.CmdLists[i] = draw_data->CmdLists[i]->CloneOutput();
+	}
+}
+
+void RenderSnapshot::clearUi()
+{
+	for (int i = 0; i < ui.CmdListsCount; i++) {
+		IM_DELETE(ui.CmdLists[i]);
+	}
+	ui.Clear();
+}
+
+// Extract this frame and hand it over, the render thread draws it while the simulation moves on to the next frame
+void RenderSystem::draw()
+{
+	RenderSnapshot& snapshot = snapshots[extract_snapshot];
+	extractSnapshot(snapshot);
+
+	if (!RENDER_ON_THREAD) {
+		renderSnapshot(snapshot);
+		shown_stats = stats;
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(snapshot_mutex);
+	// the render thread is at most one frame behind
+	snapshot_condition.wait(lock, [this] { return !snapshot_pending; });
+	extract_snapshot = 1 - extract_snapshot;
+	snapshot_pending = true;
+	lock.unlock();
+	snapshot_condition.notify_all();
+}
+
+RenderStats RenderSystem::getRenderStats()
+{
+	std::lock_guard<std::mutex> lock(snapshot_mutex);
+	return shown_stats;
+}
+
+void RenderSystem::extractSnapshot(RenderSnapshot& snapshot)
+{
+	snapshot.stats = RenderStats();
+	glfwGetFramebufferSize(window, &snapshot.framebuffer_size.x, &snapshot.framebuffer_size.y); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
+
+	// get to players position
+	assert(registry.players.size() >= 1);
+	Entity entity = registry.players.entities[0];
+	Position& player_pos = registry.positions.get(entity);
+
+	// center the camera on the player (or life orb if specified)
+	Camera camera;
+	if (registry.lifeOrbs.size() > 0 && registry.lifeOrbs.components[0].centered_on_screen) {
+		camera.centerAt(registry.positions.get(registry.lifeOrbs.entities[0]).position);
+	}
+	else {
+		camera.centerAt(player_pos.position);
+	}
+	snapshot.projection = camera.projectionMat;
+
+	// shadows fall away from the life orb if there is one, from Aria otherwise
+	snapshot.light_position = registry.lifeOrbs.size() > 0 ?
+		registry.positions.get(registry.lifeOrbs.entities[0]).position : player_pos.position;
+
+	updateViewBounds(camera);
+	snapshot.view = view_bounds;
+	collectRenderCommands(snapshot);
+	sortRenderCommands(snapshot.commands);
+
+	snapshot.lights.clear();
+	for (uint i = 0; i < registry.lightSources.size(); i++) {
+		const Entity light_entity = registry.lightSources.entities[i];
+		if (!isLightVisible(light_entity))
+			continue;
+		const LightSource& light = registry.lightSources.components[i];
+		SpriteInstance instance;
+		instance.translate_angle = vec3(registry.positions.get(light_entity).position, 0.f);
+		instance.scale = vec2(2.f * light.radius);
+		instance.frame = vec4(0.f);
+		instance.color = vec4(light.color, light.intensity);
+		instance.uv_rect = vec4(0.f, 0.f, 1.f, 1.f);
+		snapshot.lights.push_back(instance);
+	}
+
+	extractParticles(snapshot);
+
+	snapshot.screen = registry.screenStates.get(screen_state_entity);
+	snapshot.dynamic_resolution = debugging.dynamic_resolution;
+
+	// a new level's buffers go with the first snapshot that can draw it
+	snapshot.level_changed = pending_level_changed;
+	if (pending_level_changed) {
+		snapshot.level = std::move(pending_level);
+		pending_level = LevelGeometry();
+		pending_level_changed = false;
+	}
+
+	ImGui::Render();
+	snapshot.copyUi(ImGui::GetDrawData());
+}
+
+vec2 RenderSystem::repeatScale(Entity entity) const
+{
+	const Position& position = registry.positions.get(entity);
+	float x_scale = 1;
+	float y_scale = 1;
+	if (registry.terrain.has(entity)) {
+		switch (registry.directions.get(entity).direction) {
+			case DIRECTION::N: // north
+			case DIRECTION::S: // south
+				x_scale = position.scale.x / 100;
+				break;
+			case DIRECTION::E: // side
+				y_scale = position.scale.y / 100;
+				break;
+			case DIRECTION::W: // generic
+				x_scale = position.scale.x / 100;
+				y_scale = position.scale.y / 100;
+			default:
+				break;
+		}
+	}
+	else if (registry.floors.has(entity)) {
+		x_scale = position.scale.x / 100;
+		y_scale = position.scale.y / 100;
+	}
+	return { x_scale, y_scale };
+}
+
+bool RenderSystem::isLightVisible(Entity entity) const
+{
+	if (isInactiveProjectile(entity) || !registry.positions.has(entity))
+		return false;
+	const vec2 position = registry.positions.get(entity).position;
+	const float radius = registry.lightSources.get(entity).radius;
+	return position.x + radius >= view_bounds.min.x && position.x - radius <= view_bounds.max.x &&
+		position.y + radius >= view_bounds.min.y && position.y - radius <= view_bounds.max.y;
+}
+
+RenderItem RenderSystem::extractRenderItem(Entity entity, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geometry) const
+{
+	RenderItem item;
+	item.effect = effect;
+	item.texture = texture;
+	item.geometry = geometry;
+
+	if (registry.positions.has(entity)) {
+		const Position& position = registry.positions.get(entity);
+		item.sprite.translate_angle = vec3(position.position, position.angle);
+		item.sprite.scale = position.scale;
+	}
+	item.sprite.uv_rect = texture != TEXTURE_ASSET_ID::TEXTURE_COUNT ?
+		texture_uv_rects[(GLuint)texture] : vec4(0.f, 0.f, 1.f, 1.f);
+
+	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	item.sprite.color = vec4(color, 0.f);
+	item.sprite.frame = vec4(0.f);
+	if (registry.animations.has(entity)) {
+		Animation& animation = registry.animations.get(entity);
+		assert(animation.sprite_sheet_ptr != nullptr);
+		const vec2 frame_size = animation.sprite_sheet_ptr->getFrameSizeInTexcoords();
+		item.sprite.frame = vec4(animation.getColumn(), animation.getRow(), frame_size.x, frame_size.y);
+		item.sprite.color.a = animation.rainbow_enabled ? 1.f : 0.f;
+	}
+
+	if (effect == EFFECT_ASSET_ID::RESOURCE_BAR) {
+		const Resources* resources = nullptr;
+		bool mana = false;
+		if (registry.healthBars.has(entity)) {
+			resources = &registry.resources.get(registry.healthBars.get(entity).owner);
+		}
+		else if (registry.manaBars.has(entity)) {
+			resources = &registry.resources.get(registry.manaBars.get(entity).owner);
+			mana = true;
+		}
+		item.params = vec3(0.f, 0.f, 1.f);
+		if (resources != nullptr) {
+			const float fraction = mana ? resources->currentMana / resources->maxMana : resources->currentHealth / resources->maxHealth;
+			item.params = vec3(fraction, resources->logoRatio, resources->barRatio);
+		}
+	}
+	else if (effect == EFFECT_ASSET_ID::REPEAT && registry.positions.has(entity)) {
+		item.params = vec3(repeatScale(entity), 0.f);
+	}
+
+	if (registry.staticGeometries.has(entity))
+		item.static_batch = registry.staticGeometries.get(entity).batch;
+	return item;
+}
+
+void RenderSystem::queueRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity)
+{
+	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	RenderItem item = extractRenderItem(entity, render_request.used_effect, render_request.used_texture, render_request.used_geometry);
+
+	if (layer == RENDER_LAYER::HUD_TEXT) {
+		const TextLayout& layout = layoutText(entity, snapshot.stats);
+		item.first_text_vertex = (uint32_t)snapshot.text_vertices.size();
+		item.text_vertex_count = (uint32_t)layout.vertices.size();
+		snapshot.text_vertices.insert(snapshot.text_vertices.end(), layout.vertices.begin(), layout.vertices.end());
+	}
+
+	// batched sprites all draw with the instanced program, so they sort next to each other
+	const EFFECT_ASSET_ID key_effect = isBatchable(render_request.used_effect, render_request.used_texture) ?
+		EFFECT_ASSET_ID::SPRITE_INSTANCED : render_request.used_effect;
+	pushRenderCommand(snapshot, layer, key_effect, item);
+}
+
+void RenderSystem::queueRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geometry)
+{
+	pushRenderCommand(snapshot, layer, effect, extractRenderItem(entity, effect, texture, geometry));
+}
+
+void RenderSystem::pushRenderCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, EFFECT_ASSET_ID key_effect, const RenderItem& item)
+{
+	const GLuint texture = item.texture != TEXTURE_ASSET_ID::TEXTURE_COUNT ?
+		texture_gl_handles[(GLuint)item.texture] : 0;
+	const uint64_t depth = (uint64_t)snapshot.commands.size();
+
+	uint64_t key = ((uint64_t)layer << RENDER_KEY_LAYER_SHIFT) |
+		((uint64_t)key_effect << RENDER_KEY_PROGRAM_SHIFT) |
+		((uint64_t)(texture & 0x3FF) << RENDER_KEY_TEXTURE_SHIFT) |
+		((uint64_t)item.geometry << RENDER_KEY_GEOMETRY_SHIFT) |
+		(depth & 0xFFFFFFFF);
+	snapshot.commands.push_back({ key, (uint32_t)snapshot.items.size() });
+	snapshot.items.push_back(item);
+}
+
+void RenderSystem::updateViewBounds(const Camera& camera)
+{
+	const vec2 half_window = vec2(window_width_px, window_height_px) / 2.f;
+	view_bounds.min = camera.center - half_window;
+	view_bounds.max = camera.center + half_window;
+	view_bounds.center = camera.center;
+	// the lantern falls off with the distance in screen texture coordinates, so it is an ellipse in pixels
+	view_bounds.light_axes = light_radius * vec2(window_width_px, window_height_px);
+	view_bounds.only_lantern = true;
+	for (Entity entity : registry.lightSources.entities) {
+		if (isLightVisible(entity)) {
+			view_bounds.only_lantern = false;
+			break;
+		}
+	}
+
+	const ScreenState& screen = registry.screenStates.get(screen_state_entity);
+	view_bounds.spotlight_radius = screen.apply_spotlight ?
+		screen.spotlight_radius * std::max(window_width_px, window_height_px) * 0.75f : 0.f;
+}
+
+// Conservative test of the entity's bounding circle against the camera rectangle and the lit area
+bool RenderSystem::isVisible(Entity entity, float margin)
+{
+	const Position& position = registry.positions.get(entity);
+	// rotated sprites can reach up to half their diagonal from the center
+	const float radius = length(position.scale) / 2.f + margin;
+
+	if (position.position.x + radius < view_bounds.min.x || position.position.x - radius > view_bounds.max.x ||
+		position.position.y + radius < view_bounds.min.y || position.position.y - radius > view_bounds.max.y)
+		return false;
+
+	// the light ellipse grown by the radius contains every circle that touches the ellipse,
+	// other lights can reach past it though
+	const vec2 offset = (position.position - view_bounds.center) / (view_bounds.light_axes + radius);
+	if (view_bounds.only_lantern && dot(offset, offset) > 1.f)
+		return false;
+
+	if (view_bounds.spotlight_radius > 0.f &&
+		distance(position.position, view_bounds.center) > view_bounds.spotlight_radius + radius)
+		return false;
+
+	return true;
+}
+
+void RenderSystem::collectRenderCommands(RenderSnapshot& snapshot)
+{
+	snapshot.commands.clear();
+	snapshot.items.clear();
+	snapshot.text_vertices.clear();
+	RenderStats& stats = snapshot.stats;
+
+	// Only the world is culled, the HUD is always on screen
+	for (Entity entity : registry.floors.entities) {
+		if (registry.baked.has(entity))
+			continue;
+		if (isVisible(entity))
+			queueRenderCommand(snapshot, RENDER_LAYER::FLOOR, entity);
+		else
+			stats.culled_entities++;
+	}
+
+	// Shadows are queued with their owner, shadow.vs.glsl places them
+	for (uint i = 0; i < registry.castsShadows.size(); i++) {
+		const Entity entity = registry.castsShadows.entities[i];
+		const CastsShadow& casts_shadow = registry.castsShadows.components[i];
+		// a shadow reaches up to 1.5 times the owner's height past the owner
+		if (isVisible(entity, 1.5f * abs(registry.positions.get(entity).scale.y)))
+			queueRenderCommand(snapshot, RENDER_LAYER::SHADOW, entity, EFFECT_ASSET_ID::SHADOW, casts_shadow.texture, casts_shadow.geometry);
+		else
+			stats.culled_entities++;
+	}
+
+	// Baked floors and walls, their position and scale cover the whole batch
+	for (uint i = 0; i < registry.staticGeometries.size(); i++) {
+		const Entity entity = registry.staticGeometries.entities[i];
+		if (isVisible(entity))
+			queueRenderCommand(snapshot, registry.staticGeometries.components[i].floor ? RENDER_LAYER::FLOOR : RENDER_LAYER::TERRAIN, entity);
+		else
+			stats.culled_entities++;
+	}
+
+	// All textured meshes that have a position and aren't drawn by one of the other layers
+	for (Entity entity : registry.renderRequests.entities)
+	{
+		if (!registry.positions.has(entity) || registry.texts.has(entity) ||
+			registry.floors.has(entity) ||
+			registry.baked.has(entity) || registry.staticGeometries.has(entity) ||
+			registry.projectileSelectDisplays.has(entity) || registry.healthBars.has(entity) ||
+			registry.manaBars.has(entity) || registry.powerUpIndicators.has(entity) ||
+			isInactiveProjectile(entity))
+			continue;
+		if (isVisible(entity))
+			queueRenderCommand(snapshot, registry.terrain.has(entity) ? RENDER_LAYER::TERRAIN : RENDER_LAYER::WORLD, entity);
+		else
+			stats.culled_entities++;
+	}
+	stats.visible_entities = (int)snapshot.commands.size();
+
+	// The HUD is hidden during cutscenes, except for text
+	hud_items_scratch.clear();
+	if (registry.cutscenes.size() == 0) {
+		for (Entity entity : registry.healthBars.entities) {
+			queueHudCommand(snapshot, RENDER_LAYER::HUD_BARS, entity);
+		}
+		for (Entity entity : registry.manaBars.entities) {
+			queueHudCommand(snapshot, RENDER_LAYER::HUD_BARS, entity);
+		}
+	}
+
+	for (Entity entity : registry.texts.entities) {
+		queueRenderCommand(snapshot, RENDER_LAYER::HUD_TEXT, entity);
+	}
+
+	if (registry.cutscenes.size() == 0) {
+		for (Entity entity : registry.projectileSelectDisplays.entities) {
+			queueHudCommand(snapshot, RENDER_LAYER::HUD_ARSENAL, entity);
+
+			ProjectileSelectDisplay& selectDisplay = registry.projectileSelectDisplays.get(entity);
+			PowerUp& powerUp = registry.powerUps.components[0]; // lowkey unsafe
+
+			if (powerUp.fasterMovement) queueHudCommand(snapshot, RENDER_LAYER::HUD_INDICATOR, selectDisplay.fasterMovement);
+			for (int i = 0; i < 4; i++) {
+				if (powerUp.increasedDamage[i]) queueHudCommand(snapshot, RENDER_LAYER::HUD_INDICATOR, selectDisplay.increasedDamage[i]);
+				if (powerUp.tripleShot[i]) queueHudCommand(snapshot, RENDER_LAYER::HUD_INDICATOR, selectDisplay.tripleShot[i]);
+				if (powerUp.bounceOffWalls[i]) queueHudCommand(snapshot, RENDER_LAYER::HUD_INDICATOR, selectDisplay.bounceOffWalls[i]);
+			}
+		}
+	}
+	extractHud(snapshot);
+}
+
+void RenderSystem::queueHudCommand(RenderSnapshot& snapshot, RENDER_LAYER layer, Entity entity)
+{
+	// the offset to Aria comes from the followers, Aria's position would add rounding noise that changes every frame
+	Entity player = registry.players.entities[0];
+	vec2 offset = vec2(0.f);
+	Entity followed = entity;
+	if (registry.secondaryFollowers.has(entity)) {
+		const SecondaryFollower& secondary = registry.secondaryFollowers.get(entity);
+		offset += vec2(secondary.x_offset, secondary.y_offset);
+		followed = secondary.owner;
+	}
+	const bool follows_player = registry.followers.has(followed) &&
+		(unsigned int)registry.followers.get(followed).owner == (unsigned int)player;
+
+	// the rainbow changes every frame, caching it would only cost an extra pass
+	if (!follows_player || (registry.animations.has(entity) && registry.animations.get(entity).rainbow_enabled)) {
+		queueRenderCommand(snapshot, layer, entity);
+		return;
+	}
+
+	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	RenderItem item = extractRenderItem(entity, render_request.used_effect, render_request.used_texture, render_request.used_geometry);
+
+	const Follower& follower = registry.followers.get(followed);
+	offset += vec2(follower.x_offset, follower.y_offset);
+	item.sprite.translate_angle = vec3(offset, item.sprite.translate_angle.z);
+	hud_items_scratch.push_back(item);
+}
+
+static bool sameHudItem(const RenderItem& a, const RenderItem& b)
+{
+	return a.effect == b.effect && a.texture == b.texture && a.geometry == b.geometry &&
+		a.sprite.translate_angle == b.sprite.translate_angle && a.sprite.scale == b.sprite.scale &&
+		a.sprite.frame == b.sprite.frame && a.sprite.color == b.sprite.color && a.params == b.params;
+}
+
+// The cached HUD only changes with the bars' Resources, the selected projectile type and the PowerUps,
+// comparing what they turn into is cheaper than the render pass and can't miss a place that changes them
+void RenderSystem::extractHud(RenderSnapshot& snapshot)
+{
+	snapshot.hud_visible = !hud_items_scratch.empty();
+	snapshot.hud_anchor = registry.positions.get(registry.players.entities[0]).position;
+	snapshot.hud_changed = snapshot.hud_visible &&
+		!std::equal(hud_items_scratch.begin(), hud_items_scratch.end(), cached_hud_items.begin(), cached_hud_items.end(), sameHudItem);
+	snapshot.hud_items.clear();
+	if (snapshot.hud_changed) {
+		cached_hud_items = hud_items_scratch;
+		snapshot.hud_items = hud_items_scratch;
+	}
+}
+
+// LSD radix sort on the 64 bit keys, one byte per pass. Stable, so equal keys keep their submission order.
+void RenderSystem::sortRenderCommands(std::vector<RenderCommand>& commands)
+{
+	if (commands.empty())
+		return;
+
+	render_commands_scratch = commands;
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t offsets[256] = {};
+		for (const RenderCommand& command : commands) {
+			offsets[(command.key >> shift) & 0xFF]++;
+		}
+		// every key has the same byte here, the pass wouldn't move anything
+		if (offsets[(commands[0].key >> shift) & 0xFF] == commands.size())
+			continue;
+
+		size_t total = 0;
+		for (size_t& offset : offsets) {
+			size_t count = offset;
+			offset = total;
+			total += count;
+		}
+		for (const RenderCommand& command : commands) {
+			render_commands_scratch[offsets[(command.key >> shift) & 0xFF]++] = command;
+		}
+		commands.swap(render_commands_scratch);
+	}
+}
+
+// Lays the glyphs out along the baseline starting at the position, in window pixels
+const TextLayout& RenderSystem::layoutText(Entity entity, RenderStats& extract_stats)
+{
+	const Text& text = registry.texts.get(entity);
+	const Position& position = registry.positions.get(entity);
+	const float scale = position.scale.x;
+
+	const bool cached = registry.textLayouts.has(entity);
+	TextLayout& layout = cached ? registry.textLayouts.get(entity) : registry.textLayouts.emplace(entity);
+	if (cached && layout.text == text.text && layout.position == position.position && layout.scale == scale &&
+		layout.color == text.color && layout.outline == text.outline && layout.glow == text.glow)
+		return layout;
+
+	layout.text = text.text;
+	layout.position = position.position;
+	layout.scale = scale;
+	layout.color = text.color;
+	layout.outline = text.outline;
+	layout.glow = text.glow;
+	layout.vertices.clear();
+	extract_stats.text_layouts++;
+
+	float x = position.position.x;
+	float y = position.position.y;
+	for (char c : text.text)
+	{
+		auto it = Characters.find(c);
+		if (it == Characters.end())
+			continue;
+		const Character& ch = it->second;
+
+		float xpos = x + ch.Bearing.x * scale;
+		float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
+
+		float w = ch.Size.x * scale;
+		float h = ch.Size.y * scale;
+
+		// the first bitmap row is the top of the glyph
+		const vec4& uv = ch.UVRect;
+		layout.vertices.push_back({ { xpos,     ypos + h }, { uv.x, uv.y }, text.color, text.outline, text.glow });
+		layout.vertices.push_back({ { xpos,     ypos     }, { uv.x, uv.w }, text.color, text.outline, text.glow });
+		layout.vertices.push_back({ { xpos + w, ypos     }, { uv.z, uv.w }, text.color, text.outline, text.glow });
+
+		layout.vertices.push_back({ { xpos,     ypos + h }, { uv.x, uv.y }, text.color, text.outline, text.glow });
+		layout.vertices.push_back({ { xpos + w, ypos     }, { uv.z, uv.w }, text.color, text.outline, text.glow });
+		layout.vertices.push_back({ { xpos + w, ypos + h }, { uv.z, uv.y }, text.color, text.outline, text.glow });
+
+		// now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+		x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+	}
+	return layout;
+}
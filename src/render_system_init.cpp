@@ -5,12 +5,20 @@
 #include <fstream>
 
 #include "../ext/stb_image/stb_image.h"
+#include "gl_debug.hpp"
+#include "shader_cache.hpp"
+#include "texture_atlas.hpp"
 
 // This creates circular header inclusion, that is quite bad.
 #include "tiny_ecs_registry.hpp"
 
 // stlib
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 // define our font path
@@ -20,6 +28,30 @@
 	#define FONT_PATH "../../../data/fonts/PixeloidSans.ttf"
 #endif
 
+// Packed atlas layout of the last launch, see texture_atlas.hpp
+const std::string ATLAS_LAYOUT_PATH = data_path() + "/textures/atlas_layout.cache";
+
+// Textures sampled outside of [0, 1] (the repeating floors and walls) or by their texture coordinates
+// (the resource bars fill up along x) can't live in an atlas
+static bool isAtlasTexture(TEXTURE_ASSET_ID id)
+{
+	switch (id) {
+	case TEXTURE_ASSET_ID::NORTH_TERRAIN:
+	case TEXTURE_ASSET_ID::SOUTH_TERRAIN:
+	case TEXTURE_ASSET_ID::SIDE_TERRAIN:
+	case TEXTURE_ASSET_ID::GENERIC_TERRAIN:
+	case TEXTURE_ASSET_ID::FLOOR:
+	case TEXTURE_ASSET_ID::BOSS_HEALTH_BAR:
+	case TEXTURE_ASSET_ID::ENEMY_HEALTH_BAR:
+	case TEXTURE_ASSET_ID::ENEMY_MANA_BAR:
+	case TEXTURE_ASSET_ID::PLAYER_HEALTH_BAR:
+	case TEXTURE_ASSET_ID::PLAYER_MANA_BAR:
+		return false;
+	default:
+		return true;
+	}
+}
+
 // World initialization
 bool RenderSystem::init(GLFWwindow* window_arg)
 {
@@ -49,19 +81,14 @@ bool RenderSystem::init(GLFWwindow* window_arg)
 		printf("window width_height = %d,%d\n", window_width_px, window_height_px);
 	}
 
-	// Hint: Ask your TA for how to setup pretty OpenGL error callbacks. 
-	// This can not be done in mac os, so do not enable
-	// it unless you are on Linux or Windows. You will need to change the window creation
-	// code to use OpenGL 4.3 (not suported on mac) and add additional .h and .cpp
-	// glDebugMessageCallback((GLDEBUGPROC)errorCallback, nullptr);
-
-	// We are not really using VAO's but without at least one bound we will crash in
-	// some systems.
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	gl_has_errors();
+	// GL errors go to a callback where the context supports it (not on mac), see gl_debug.hpp
+	initGlDebugOutput();
 
 	initScreenTexture();
+	initLightBuffer();
+	initGpuTimers();
+	initHudBuffer();
+	initParticles();
     initializeGlTextures();
 	initializeGlEffects();
 	initializeSpriteSheets(); // must be called before initializeGlGeometryBuffers()
@@ -69,6 +96,12 @@ bool RenderSystem::init(GLFWwindow* window_arg)
 	initializeImGui();
 	initializeFreeType();
 
+	if (RENDER_ON_THREAD) {
+		// from here on only the render thread makes GL calls
+		glfwMakeContextCurrent(nullptr);
+		render_thread = std::thread(&RenderSystem::renderLoop, this);
+	}
+
 	return true;
 }
 
@@ -90,57 +123,80 @@ void RenderSystem::initializeFreeType() {
 	}
 	else {
 		// set size to load glyphs as
-		FT_Set_Pixel_Sizes(face, 0, 48);
+		FT_Set_Pixel_Sizes(face, 0, FONT_PIXEL_SIZE);
 
 		// disable byte-alignment restriction
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-		// load first 128 characters of ASCII set
+		// load first 128 characters of ASCII set, the bitmaps are kept until they are packed
+		std::vector<std::vector<unsigned char>> bitmaps(128);
+		std::vector<ivec2> origins(128);
 		for (unsigned char c = 0; c < 128; c++)
 		{
-			// Load character glyph 
-			if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+			// Load character glyph, then turn the coverage bitmap into a distance field (FreeType's bsdf renderer).
+			// The field reaches 8 px beyond the outline, bitmap_left and bitmap_top include that margin.
+			if (FT_Load_Char(face, c, FT_LOAD_RENDER) || FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF))
 			{
 				std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
 				continue;
 			}
-			// generate texture
-			GLuint texture;
-			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
-			glTexImage2D(
-				GL_TEXTURE_2D,
-				0,
-				GL_RED,
-				face->glyph->bitmap.width,
-				face->glyph->bitmap.rows,
-				0,
-				GL_RED,
-				GL_UNSIGNED_BYTE,
-				face->glyph->bitmap.buffer
-			);
-			// set texture options
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			const FT_Bitmap& bitmap = face->glyph->bitmap;
+			bitmaps[c].resize(bitmap.width * bitmap.rows);
+			for (unsigned int row = 0; row < bitmap.rows; row++) {
+				memcpy(bitmaps[c].data() + row * bitmap.width, bitmap.buffer + row * bitmap.pitch, bitmap.width);
+			}
 			// now store character for later use
 			Character character = {
-				texture,
-				glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
+				vec4(0.f),
+				glm::ivec2(bitmap.width, bitmap.rows),
 				glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
 				static_cast<unsigned int>(face->glyph->advance.x)
 			};
 			Characters.insert(std::pair<char, Character>(c, character));
 		}
+
+		// pack every glyph into one texture, growing it until they all fit
+		int atlas_size = 256;
+		bool packed = false;
+		while (!packed) {
+			SkylinePacker packer;
+			packer.init(atlas_size, atlas_size);
+			packed = true;
+			for (auto& entry : Characters) {
+				const ivec2 padded = entry.second.Size + ivec2(TEXTURE_ATLAS_PADDING);
+				if (!packer.insert(padded, origins[(unsigned char)entry.first])) {
+					packed = false;
+					atlas_size *= 2;
+					break;
+				}
+			}
+		}
+
+		std::vector<unsigned char> pixels(atlas_size * atlas_size, 0);
+		for (auto& entry : Characters) {
+			Character& ch = entry.second;
+			const unsigned char c = (unsigned char)entry.first;
+			const ivec2 origin = origins[c];
+			for (int row = 0; row < ch.Size.y; row++) {
+				memcpy(&pixels[(origin.y + row) * atlas_size + origin.x], bitmaps[c].data() + row * ch.Size.x, ch.Size.x);
+			}
+			ch.UVRect = vec4(origin, origin + ch.Size) / (float)atlas_size;
+		}
+
+		glGenTextures(1, &glyph_atlas);
+		glBindTexture(GL_TEXTURE_2D, glyph_atlas);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas_size, atlas_size, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+		// set texture options
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	}
 	// destroy FreeType once we're finished
 	FT_Done_Face(face);
 	FT_Done_FreeType(ft);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(uint)GEOMETRY_BUFFER_ID::TEXT_2D]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-
 	gl_has_errors();
 }
 
@@ -164,59 +220,487 @@ void RenderSystem::initializeImGui()
 	// Setup Platform/Renderer backends
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init();
+	// ImGui_ImplOpenGL3_NewFrame would otherwise create these on the simulation thread, which has no context
+	ImGui_ImplOpenGL3_CreateDeviceObjects();
 }
 
 void RenderSystem::initializeGlTextures()
 {
-    glGenTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	std::vector<stbi_uc*> images(texture_paths.size());
+	std::vector<ivec2> sizes(texture_paths.size());
+	std::vector<bool> packable(texture_paths.size());
+	std::vector<std::string> names(texture_paths.begin(), texture_paths.end());
 
-    for(uint i = 0; i < texture_paths.size(); i++)
-    {
+	for(uint i = 0; i < texture_paths.size(); i++)
+	{
 		const std::string& path = texture_paths[i];
 		ivec2& dimensions = texture_dimensions[i];
 
-		stbi_uc* data;
-		data = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
+		images[i] = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
 
-		if (data == NULL)
+		if (images[i] == NULL)
 		{
 			const std::string message = "Could not load the file " + path + ".";
 			fprintf(stderr, "%s", message.c_str());
 			assert(false);
 		}
-		glBindTexture(GL_TEXTURE_2D, texture_gl_handles[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimensions.x, dimensions.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		sizes[i] = dimensions;
+		packable[i] = isAtlasTexture((TEXTURE_ASSET_ID)i);
+	}
+
+	GLint max_texture_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+	const int atlas_max_size = std::min(TEXTURE_ATLAS_MAX_SIZE, (int)max_texture_size);
+
+	// Packing only depends on the image sizes, reuse the layout of the last launch if nothing changed
+	AtlasLayout layout;
+	if (!loadAtlasLayout(ATLAS_LAYOUT_PATH, names, sizes, atlas_max_size, layout)) {
+		layout = packTextureAtlases(sizes, packable, atlas_max_size);
+		saveAtlasLayout(ATLAS_LAYOUT_PATH, names, sizes, layout);
+	}
+
+	// Copy the packed images into one buffer per atlas
+	std::vector<std::vector<stbi_uc>> atlas_pixels(layout.atlas_sizes.size());
+	for (uint a = 0; a < layout.atlas_sizes.size(); a++) {
+		atlas_pixels[a].assign((size_t)layout.atlas_sizes[a].x * layout.atlas_sizes[a].y * 4, 0);
+	}
+	for (uint i = 0; i < texture_paths.size(); i++) {
+		const AtlasPlacement& placement = layout.placements[i];
+		if (placement.atlas < 0) continue;
+		const ivec2 atlas_size = layout.atlas_sizes[placement.atlas];
+		for (int row = 0; row < sizes[i].y; row++) {
+			const stbi_uc* src = images[i] + (size_t)row * sizes[i].x * 4;
+			stbi_uc* dst = atlas_pixels[placement.atlas].data() +
+				((size_t)(placement.origin.y + row) * atlas_size.x + placement.origin.x) * 4;
+			std::copy(src, src + sizes[i].x * 4, dst);
+		}
+	}
+
+	std::vector<GLuint> atlas_handles(layout.atlas_sizes.size());
+	glGenTextures((GLsizei)atlas_handles.size(), atlas_handles.data());
+	for (uint a = 0; a < atlas_handles.size(); a++) {
+		glBindTexture(GL_TEXTURE_2D, atlas_handles[a]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, layout.atlas_sizes[a].x, layout.atlas_sizes[a].y, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlas_pixels[a].data());
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		gl_has_errors();
-		stbi_image_free(data);
-    }
+	}
+
+	// Atlased textures share the atlas handle, the rest (tiling and resource bar textures) keep their own
+	for (uint i = 0; i < texture_paths.size(); i++) {
+		const AtlasPlacement& placement = layout.placements[i];
+		if (placement.atlas >= 0) {
+			const vec2 atlas_size = layout.atlas_sizes[placement.atlas];
+			texture_gl_handles[i] = atlas_handles[placement.atlas];
+			texture_uv_rects[i] = vec4(vec2(placement.origin) / atlas_size, vec2(sizes[i]) / atlas_size);
+		}
+		else {
+			glGenTextures(1, &texture_gl_handles[i]);
+			glBindTexture(GL_TEXTURE_2D, texture_gl_handles[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, sizes[i].x, sizes[i].y, 0, GL_RGBA, GL_UNSIGNED_BYTE, images[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			gl_has_errors();
+			texture_uv_rects[i] = vec4(0.f, 0.f, 1.f, 1.f);
+		}
+		stbi_image_free(images[i]);
+	}
+	printf("Packed %zu textures into %zu atlases\n", std::count(packable.begin(), packable.end(), true), atlas_handles.size());
+}
+
+static bool readShaderFile(const std::string& path, std::string& out_source)
+{
+	std::ifstream file(path);
+	if (!file.good())
+		return false;
+	std::stringstream ss;
+	ss << file.rdbuf();
+	out_source = ss.str();
+	return true;
+}
+
+// Compiling only starts here, the status is checked once every effect was issued
+static GLuint createShader(GLenum type, const std::string& source)
+{
+	const char* src = source.c_str();
+	const GLsizei len = (GLsizei)source.size();
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &src, &len);
+	glCompileShader(shader);
+	gl_has_errors();
+	return shader;
+}
+
+static bool shaderCompiled(GLuint shader)
+{
+	GLint success = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (success == GL_FALSE)
+	{
+		GLint log_len;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
+		std::vector<char> log(log_len);
+		glGetShaderInfoLog(shader, log_len, &log_len, log.data());
+
+		gl_has_errors();
+
+		fprintf(stderr, "GLSL: %s", log.data());
+		return false;
+	}
+
+	return true;
+}
+
+// Issues the compile and link of one effect without waiting for either
+static GLuint createEffect(GLuint vertex, GLuint fragment, bool retrievable)
+{
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	// fixed attribute locations, see render_system.hpp
+	glBindAttribLocation(program, ATTRIBUTE_POSITION, "in_position");
+	glBindAttribLocation(program, ATTRIBUTE_POSITION, "vertex");
+	glBindAttribLocation(program, ATTRIBUTE_TEXCOORD, "in_texcoord");
+	glBindAttribLocation(program, ATTRIBUTE_COLOR, "in_color");
+	glBindAttribLocation(program, ATTRIBUTE_TEXT_OUTLINE, "in_outline");
+	glBindAttribLocation(program, ATTRIBUTE_TEXT_GLOW, "in_glow");
+	if (retrievable)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	gl_has_errors();
+	return program;
 }
 
+// Waits for the effect and reports what went wrong, if anything
+static bool finishEffect(GLuint vertex, GLuint fragment, GLuint program)
+{
+	bool is_valid = true;
+	if (!shaderCompiled(vertex))
+	{
+		fprintf(stderr, "Vertex compilation failed");
+		is_valid = false;
+	}
+	if (!shaderCompiled(fragment))
+	{
+		fprintf(stderr, "Fragment compilation failed");
+		is_valid = false;
+	}
+
+	GLint is_linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+	if (is_valid && is_linked == GL_FALSE)
+	{
+		GLint log_len;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_len);
+		std::vector<char> log(log_len);
+		glGetProgramInfoLog(program, log_len, &log_len, log.data());
+		gl_has_errors();
+
+		fprintf(stderr, "Link error: %s", log.data());
+		is_valid = false;
+	}
+
+	// No need to carry this around. Keeping these objects is only useful if we recycle
+	// the same shaders over and over, which we don't, so no need and this is simpler.
+	glDetachShader(program, vertex);
+	glDetachShader(program, fragment);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	gl_has_errors();
+
+	return is_valid;
+}
+
+// Effects come from the program cache when their sources and the driver haven't changed since the last launch.
+// The others are all issued before any is waited on, so drivers with parallel compiling build them side by side.
 void RenderSystem::initializeGlEffects()
 {
+	const auto start = std::chrono::steady_clock::now();
+	const bool use_binaries = programBinariesSupported();
+	const bool parallel = enableParallelShaderCompile();
+
+	std::array<GLuint, effect_count> vertex_shaders = {};
+	std::array<GLuint, effect_count> fragment_shaders = {};
+	std::array<uint64_t, effect_count> cache_keys = {};
+	std::array<std::string, effect_count> names;
+	int cached = 0;
+	int loaded = 0;
 	for(uint i = 0; i < effect_paths.size(); i++)
 	{
-		const std::string vertex_shader_name = effect_paths[i] + ".vs.glsl";
-		const std::string fragment_shader_name = effect_paths[i] + ".fs.glsl";
+		// effects without a program of their own
+		effects[i] = 0;
+		if (effect_paths[i].empty())
+			continue;
+		loaded++;
 
-		bool is_valid = loadEffectFromFile(vertex_shader_name, fragment_shader_name, effects[i]);
-		assert(is_valid && (GLuint)effects[i] != 0);
+		names[i] = effect_paths[i].substr(effect_paths[i].find_last_of('/') + 1);
+
+		std::string vs_source;
+		std::string fs_source;
+		if (!readShaderFile(effect_paths[i] + ".vs.glsl", vs_source) || !readShaderFile(effect_paths[i] + ".fs.glsl", fs_source))
+		{
+			fprintf(stderr, "Failed to load shader files of %s", effect_paths[i].c_str());
+			assert(false);
+			continue;
+		}
+
+		cache_keys[i] = programCacheKey(vs_source, fs_source);
+		if (use_binaries && loadProgramBinary(names[i], cache_keys[i], effects[i])) {
+			cached++;
+			continue;
+		}
+
+		vertex_shaders[i] = createShader(GL_VERTEX_SHADER, vs_source);
+		fragment_shaders[i] = createShader(GL_FRAGMENT_SHADER, fs_source);
+		effects[i] = createEffect(vertex_shaders[i], fragment_shaders[i], use_binaries);
+	}
+
+	for(uint i = 0; i < effect_paths.size(); i++)
+	{
+		if (effect_paths[i].empty())
+			continue;
+		if (vertex_shaders[i] != 0) {
+			bool is_valid = finishEffect(vertex_shaders[i], fragment_shaders[i], effects[i]);
+			assert(is_valid);
+			if (is_valid && use_binaries)
+				saveProgramBinary(names[i], cache_keys[i], effects[i]);
+		}
+		assert((GLuint)effects[i] != 0);
+		programs[i].reflect(effects[i]);
 	}
+
+	const float elapsed_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Loaded %d effects in %.1f ms, %d from the program cache%s\n", loaded, elapsed_ms, cached,
+		parallel ? ", the rest compiled in parallel" : "");
+}
+
+// Vertex layouts recorded into a geometry's VAO, picked by the vertex type of bindVBOandIBO
+static void specifyVertexLayout(const TexturedVertex*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)0);
+	glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+	glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)sizeof(vec3)); // note the stride to skip the preceeding vertex position
+}
+
+static void specifyVertexLayout(const ColoredVertex*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)0);
+	glEnableVertexAttribArray(ATTRIBUTE_COLOR);
+	glVertexAttribPointer(ATTRIBUTE_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)sizeof(vec3));
+}
+
+static void specifyVertexLayout(const vec3*)
+{
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
 }
 
 // One could merge the following two functions as a template function...
 template <class T>
 void RenderSystem::bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices, std::vector<uint16_t> indices)
 {
+	// the element buffer binding and the attribute pointers are recorded into the VAO
+	glBindVertexArray(vertex_arrays[(uint)gid]);
+
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(uint)gid]);
 	glBufferData(GL_ARRAY_BUFFER,
 		sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+	specifyVertexLayout(vertices.data());
 	gl_has_errors();
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(uint)gid]);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 		sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	index_counts[(uint)gid] = (GLsizei)indices.size();
+	gl_has_errors();
+
+	glBindVertexArray(0);
+}
+
+void RenderSystem::bakeStaticGeometry()
+{
+	// only CPU work here, the render thread swaps the buffers once it gets to the first snapshot of this level
+	pending_level = LevelGeometry();
+	pending_level_changed = true;
+
+	// floors go into the tile map as long as they are plain axis aligned quads of the floor texture
+	std::vector<vec4> floor_rects;
+	for (Entity entity : registry.floors.entities) {
+		if (floor_rects.size() == TILE_MAP_MAX_TILES || !registry.positions.has(entity) ||
+			!registry.renderRequests.has(entity) || registry.colors.has(entity))
+			continue;
+		const RenderRequest& render_request = registry.renderRequests.get(entity);
+		const Position& position = registry.positions.get(entity);
+		if (render_request.used_effect != EFFECT_ASSET_ID::REPEAT || render_request.used_texture != TEXTURE_ASSET_ID::FLOOR ||
+			position.angle != 0.f)
+			continue;
+		const vec2 half = abs(position.scale) / 2.f;
+		floor_rects.push_back(vec4(position.position - half, position.position + half));
+		registry.baked.emplace(entity);
+	}
+	pending_level.tile_map.build(floor_rects);
+
+	struct Bake {
+		TEXTURE_ASSET_ID texture;
+		bool floor;
+		std::vector<TexturedVertex> vertices;
+		std::vector<uint16_t> indices;
+		vec2 min;
+		vec2 max;
+	};
+	std::vector<Bake> bakes;
+
+	// corners of the SPRITE geometry, see initializeSpriteGeometryBuffer
+	const Mesh& sprite = meshes[(uint)GEOMETRY_BUFFER_ID::SPRITE];
+	const vec2 corner_texcoords[4] = { { 0.f, 1.f }, { 1.f, 1.f }, { 1.f, 0.f }, { 0.f, 0.f } };
+
+	for (Entity entity : registry.renderRequests.entities) {
+		const RenderRequest& render_request = registry.renderRequests.get(entity);
+		const bool floor = registry.floors.has(entity);
+		const bool wall = registry.terrain.has(entity) && !registry.terrain.get(entity).moveable;
+		if ((!floor && !wall) || registry.baked.has(entity) || !registry.positions.has(entity) || registry.colors.has(entity) ||
+			render_request.used_effect != EFFECT_ASSET_ID::REPEAT ||
+			render_request.used_geometry != GEOMETRY_BUFFER_ID::SPRITE)
+			continue;
+
+		// floors and walls stay apart since they draw in different layers, indices are 16 bit
+		Bake* bake = nullptr;
+		for (Bake& candidate : bakes) {
+			if (candidate.texture == render_request.used_texture && candidate.floor == floor &&
+				candidate.vertices.size() + 4 <= std::numeric_limits<uint16_t>::max())
+				bake = &candidate;
+		}
+		if (bake == nullptr) {
+			bakes.push_back({ render_request.used_texture, floor, {}, {}, vec2(FLT_MAX), vec2(-FLT_MAX) });
+			bake = &bakes.back();
+		}
+
+		const Position& position = registry.positions.get(entity);
+		Transform transform;
+		transform.translate(position.position);
+		transform.rotate(position.angle);
+		transform.scale(position.scale);
+		const vec2 repeat_scale = repeatScale(entity);
+
+		const uint16_t base = (uint16_t)bake->vertices.size();
+		for (int i = 0; i < 4; i++) {
+			const vec3 corner = transform.mat * vec3(sprite.vertices[i].position.x, sprite.vertices[i].position.y, 1.f);
+			bake->vertices.push_back({ vec3(corner.x, corner.y, sprite.vertices[i].position.z), corner_texcoords[i] * repeat_scale });
+			bake->min = min(bake->min, vec2(corner));
+			bake->max = max(bake->max, vec2(corner));
+		}
+		for (uint16_t index : sprite.vertex_indices) {
+			bake->indices.push_back(base + index);
+		}
+		registry.baked.emplace(entity);
+	}
+
+	for (Bake& bake : bakes) {
+		// the bounds make the batch cullable like any other entity
+		Entity entity = Entity();
+		Position& position = registry.positions.emplace(entity);
+		position.position = (bake.min + bake.max) / 2.f;
+		position.scale = bake.max - bake.min;
+
+		StaticGeometry& geometry = registry.staticGeometries.emplace(entity);
+		geometry.batch = (int)pending_level.batches.size();
+		geometry.floor = bake.floor;
+
+		registry.renderRequests.insert(
+			entity,
+			{ bake.texture,
+				EFFECT_ASSET_ID::REPEAT,
+				GEOMETRY_BUFFER_ID::SPRITE });
+
+		pending_level.batches.push_back({ std::move(bake.vertices), std::move(bake.indices) });
+	}
+}
+
+void RenderSystem::uploadLevel(LevelGeometry& level)
+{
+	// the batches of the previous level went away with its entities, their buffers didn't
+	glDeleteVertexArrays((GLsizei)static_geometry_arrays.size(), static_geometry_arrays.data());
+	glDeleteBuffers((GLsizei)static_geometry_buffers.size(), static_geometry_buffers.data());
+	static_geometry_arrays.clear();
+	static_geometry_buffers.clear();
+	static_geometry_index_counts.clear();
+
+	tile_map = std::move(level.tile_map);
+	uploadTileMap();
+
+	for (const StaticBatch& batch : level.batches) {
+		GLuint vertex_array;
+		GLuint buffers[2];
+		glGenVertexArrays(1, &vertex_array);
+		glGenBuffers(2, buffers);
+		static_geometry_arrays.push_back(vertex_array);
+		static_geometry_buffers.push_back(buffers[0]);
+		static_geometry_buffers.push_back(buffers[1]);
+		static_geometry_index_counts.push_back((GLsizei)batch.indices.size());
+
+		glBindVertexArray(vertex_array);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, batch.vertices.size() * sizeof(TexturedVertex), batch.vertices.data(), GL_STATIC_DRAW);
+		specifyVertexLayout(batch.vertices.data());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, batch.indices.size() * sizeof(uint16_t), batch.indices.data(), GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		gl_has_errors();
+	}
+	level = LevelGeometry();
+}
+
+// Lookup textures of the tile map, fetched per texel so they are never filtered
+static GLuint createTileMapTexture(GLint internal_format, ivec2 size, GLenum format, GLenum type, const void* pixels)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return texture;
+}
+
+void RenderSystem::uploadTileMap()
+{
+	const GLuint textures[] = { tile_chunk_table, tile_chunk_atlas, tile_palette };
+	glDeleteTextures(3, textures);
+	tile_chunk_table = 0;
+	tile_chunk_atlas = 0;
+	tile_palette = 0;
+	if (tile_map.empty())
+		return;
+
+	// chunks are laid out side by side in a roughly square texture
+	const int slot_count = (int)tile_map.chunks.size();
+	tile_chunk_slots_per_row = (int)ceil(sqrt((float)slot_count));
+	const int slot_rows = (slot_count + tile_chunk_slots_per_row - 1) / tile_chunk_slots_per_row;
+	const ivec2 atlas_size = ivec2(tile_chunk_slots_per_row, slot_rows) * TILE_MAP_CHUNK_SIZE;
+
+	std::vector<uint8_t> atlas(atlas_size.x * atlas_size.y, 0);
+	for (int slot = 0; slot < slot_count; slot++) {
+		const ivec2 corner = ivec2(slot % tile_chunk_slots_per_row, slot / tile_chunk_slots_per_row) * TILE_MAP_CHUNK_SIZE;
+		for (int row = 0; row < TILE_MAP_CHUNK_SIZE; row++) {
+			memcpy(&atlas[(corner.y + row) * atlas_size.x + corner.x], &tile_map.chunks[slot][row * TILE_MAP_CHUNK_SIZE], TILE_MAP_CHUNK_SIZE);
+		}
+	}
+
+	// 0 marks an empty chunk, so slots are stored off by one
+	std::vector<uint16_t> table(tile_map.chunk_slots.size());
+	for (size_t i = 0; i < table.size(); i++) {
+		table[i] = (uint16_t)(tile_map.chunk_slots[i] + 1);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	tile_chunk_table = createTileMapTexture(GL_R16UI, tile_map.chunk_count, GL_RED_INTEGER, GL_UNSIGNED_SHORT, table.data());
+	tile_chunk_atlas = createTileMapTexture(GL_R8UI, atlas_size, GL_RED_INTEGER, GL_UNSIGNED_BYTE, atlas.data());
+	tile_palette = createTileMapTexture(GL_RG32F, ivec2((int)tile_map.tile_origins.size(), 1), GL_RG, GL_FLOAT, tile_map.tile_origins.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	gl_has_errors();
 }
 
@@ -713,6 +1197,13 @@ void RenderSystem::initializeGlGeometryBuffers()
 	glGenBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	// Index Buffer creation.
 	glGenBuffers((GLsizei)index_buffers.size(), index_buffers.data());
+	// Per instance data of the sprite batcher and the glyph quads of all texts (which have no index buffer),
+	// streamed every frame in flushSprites and flushText
+	sprite_instance_buffer.init(GL_ARRAY_BUFFER, SPRITE_INSTANCES_PER_FRAME * sizeof(SpriteInstance));
+	text_vertex_buffer.init(GL_ARRAY_BUFFER, TEXT_VERTICES_PER_FRAME * sizeof(TextVertex));
+	glGenVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
+	index_counts.fill(0);
+	gl_has_errors();
 
 	// Index and Vertex buffer data initialization.
 	initializeGlMeshes();
@@ -748,12 +1239,39 @@ void RenderSystem::initializeGlGeometryBuffers()
 
 RenderSystem::~RenderSystem()
 {
+	// let the render thread finish its frame, the context comes back to this thread for the cleanup
+	if (render_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(snapshot_mutex);
+			render_thread_quit = true;
+		}
+		snapshot_condition.notify_all();
+		render_thread.join();
+		glfwMakeContextCurrent(window);
+	}
+
 	// Don't need to free gl resources since they last for as long as the program,
 	// but it's polite to clean after yourself.
 	glDeleteBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	glDeleteBuffers((GLsizei)index_buffers.size(), index_buffers.data());
+	sprite_instance_buffer.destroy();
+	text_vertex_buffer.destroy();
+	glDeleteVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
+	glDeleteVertexArrays((GLsizei)static_geometry_arrays.size(), static_geometry_arrays.data());
+	glDeleteBuffers((GLsizei)static_geometry_buffers.size(), static_geometry_buffers.data());
+	// atlases appear several times, deleting an already deleted name is ignored by GL
 	glDeleteTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
 	glDeleteTextures(1, &off_screen_render_buffer_color);
+	glDeleteTextures(1, &light_texture);
+	glDeleteFramebuffers(1, &light_frame_buffer);
+	glDeleteTextures(1, &hud_texture);
+	glDeleteFramebuffers(1, &hud_frame_buffer);
+	glDeleteBuffers(1, &particle_buffer);
+	glDeleteVertexArrays(1, &particle_vertex_array);
+	glDeleteQueries(GPU_TIMER_QUERY_COUNT, gpu_timer_queries.data());
+	glDeleteTextures(1, &glyph_atlas);
+	const GLuint tile_map_textures[] = { tile_chunk_table, tile_chunk_atlas, tile_palette };
+	glDeleteTextures(3, tile_map_textures);
 	glDeleteRenderbuffers(1, &off_screen_render_buffer_depth);
 	gl_has_errors();
 
@@ -769,6 +1287,60 @@ RenderSystem::~RenderSystem()
 	    registry.remove_all_components_of(registry.renderRequests.entities.back());
 }
 
+void RenderSystem::initLightBuffer()
+{
+	int framebuffer_width, framebuffer_height;
+	glfwGetFramebufferSize(const_cast<GLFWwindow*>(window), &framebuffer_width, &framebuffer_height);
+	light_buffer_size = max(ivec2(framebuffer_width, framebuffer_height) / LIGHT_BUFFER_DOWNSCALE, ivec2(1));
+
+	// linear filtering smooths the lights when the buffer is stretched over the screen
+	glGenTextures(1, &light_texture);
+	glBindTexture(GL_TEXTURE_2D, light_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, light_buffer_size.x, light_buffer_size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_has_errors();
+
+	glGenFramebuffers(1, &light_frame_buffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, light_frame_buffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, light_texture, 0);
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+	gl_has_errors();
+}
+
+void RenderSystem::initHudBuffer()
+{
+	int framebuffer_width, framebuffer_height;
+	glfwGetFramebufferSize(const_cast<GLFWwindow*>(window), &framebuffer_width, &framebuffer_height);
+
+	// one texel per pixel when the camera is on Aria, nearest keeps the bars sharp
+	glGenTextures(1, &hud_texture);
+	glBindTexture(GL_TEXTURE_2D, hud_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_has_errors();
+
+	glGenFramebuffers(1, &hud_frame_buffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, hud_frame_buffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, hud_texture, 0);
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+	gl_has_errors();
+}
+
+void RenderSystem::initGpuTimers()
+{
+	glGenQueries(GPU_TIMER_QUERY_COUNT, gpu_timer_queries.data());
+	gpu_timer_pending.fill(false);
+	gl_has_errors();
+}
+
 // Initialize the screen texture from a standard sprite
 bool RenderSystem::initScreenTexture()
 {
@@ -796,105 +1368,3 @@ bool RenderSystem::initScreenTexture()
 	return true;
 }
 
-bool gl_compile_shader(GLuint shader)
-{
-	glCompileShader(shader);
-	gl_has_errors();
-	GLint success = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-	if (success == GL_FALSE)
-	{
-		GLint log_len;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
-		std::vector<char> log(log_len);
-		glGetShaderInfoLog(shader, log_len, &log_len, log.data());
-		glDeleteShader(shader);
-
-		gl_has_errors();
-
-		fprintf(stderr, "GLSL: %s", log.data());
-		return false;
-	}
-
-	return true;
-}
-
-bool loadEffectFromFile(
-	const std::string& vs_path, const std::string& fs_path, GLuint& out_program)
-{
-	// Opening files
-	std::ifstream vs_is(vs_path);
-	std::ifstream fs_is(fs_path);
-	if (!vs_is.good() || !fs_is.good())
-	{
-		fprintf(stderr, "Failed to load shader files %s, %s", vs_path.c_str(), fs_path.c_str());
-		assert(false);
-		return false;
-	}
-
-	// Reading sources
-	std::stringstream vs_ss, fs_ss;
-	vs_ss << vs_is.rdbuf();
-	fs_ss << fs_is.rdbuf();
-	std::string vs_str = vs_ss.str();
-	std::string fs_str = fs_ss.str();
-	const char* vs_src = vs_str.c_str();
-	const char* fs_src = fs_str.c_str();
-	GLsizei vs_len = (GLsizei)vs_str.size();
-	GLsizei fs_len = (GLsizei)fs_str.size();
-
-	GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vs_src, &vs_len);
-	GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fs_src, &fs_len);
-	gl_has_errors();
-
-	// Compiling
-	if (!gl_compile_shader(vertex))
-	{
-		fprintf(stderr, "Vertex compilation failed");
-		assert(false);
-		return false;
-	}
-	if (!gl_compile_shader(fragment))
-	{
-		fprintf(stderr, "Vertex compilation failed");
-		assert(false);
-		return false;
-	}
-
-	// Linking
-	out_program = glCreateProgram();
-	glAttachShader(out_program, vertex);
-	glAttachShader(out_program, fragment);
-	glLinkProgram(out_program);
-	gl_has_errors();
-
-	{
-		GLint is_linked = GL_FALSE;
-		glGetProgramiv(out_program, GL_LINK_STATUS, &is_linked);
-		if (is_linked == GL_FALSE)
-		{
-			GLint log_len;
-			glGetProgramiv(out_program, GL_INFO_LOG_LENGTH, &log_len);
-			std::vector<char> log(log_len);
-			glGetProgramInfoLog(out_program, log_len, &log_len, log.data());
-			gl_has_errors();
-
-			fprintf(stderr, "Link error: %s", log.data());
-			assert(false);
-			return false;
-		}
-	}
-
-	// No need to carry this around. Keeping these objects is only useful if we recycle
-	// the same shaders over and over, which we don't, so no need and this is simpler.
-	glDetachShader(out_program, vertex);
-	glDetachShader(out_program, fragment);
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-	gl_has_errors();
-
-	return true;
-}
-
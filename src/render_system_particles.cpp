@@ -0,0 +1,194 @@
+// internal
+#include "render_system.hpp"
+
+#include "tiny_ecs_registry.hpp"
+#include "projectile_pool.hpp"
+
+// stlib
+#include <algorithm>
+
+// How the particles of one burst spread out and fade, the rest comes from the emitter
+struct ParticleEffectParams {
+	int count;
+	float lifetime;     // seconds, each particle lives between half of this and all of it
+	float speed;        // px/s away from the origin, in a random direction
+	float speed_spread; // up to this much faster
+	float start_size;   // px
+	float end_size;
+	float drag;         // how quickly the particles slow down, 0 keeps them going
+};
+
+static const ParticleEffectParams PARTICLE_EFFECTS[] = {
+	{ 4, 0.35f, 15.f, 25.f, 7.f, 1.f, 2.f },    // TRAIL
+	{ 20, 0.3f, 200.f, 150.f, 5.f, 1.f, 8.f },  // HIT_SPARK
+	{ 64, 0.8f, 120.f, 160.f, 9.f, 2.f, 3.f },  // DEATH_BURST
+};
+static_assert(sizeof(PARTICLE_EFFECTS) / sizeof(PARTICLE_EFFECTS[0]) == (size_t)PARTICLE_EFFECT_COUNT,
+	"every particle effect needs its parameters");
+
+void RenderSystem::emitParticles(PARTICLE_EFFECT effect, vec2 position, vec3 color, vec2 velocity)
+{
+	const ParticleEffectParams& params = PARTICLE_EFFECTS[(int)effect];
+	assert(params.count <= MAX_PARTICLES_PER_BURST);
+
+	// Drop the burst rather than the oldest one, so a slot is only written again once its burst is gone
+	// and the upload never has to wait for draws still reading it
+	ParticleRing& ring = particle_rings[(int)effect];
+	if (ring.count == MAX_PARTICLE_BURSTS_PER_EFFECT)
+		return;
+
+	EmittedParticleBurst emitted;
+	emitted.slot = (int)effect * MAX_PARTICLE_BURSTS_PER_EFFECT + ring.next;
+	emitted.burst.origin_time = vec4(position, particle_time, params.lifetime);
+	emitted.burst.velocity = vec4(velocity, params.speed, params.speed_spread);
+	// any value works as a seed, it only has to differ between bursts
+	particle_seed = fmod(particle_seed + 7.31f, 1000.f);
+	emitted.burst.color = vec4(color, particle_seed);
+	emitted.burst.shape = vec4((float)params.count, params.start_size, params.end_size, params.drag);
+	emitted_particle_bursts.push_back(emitted);
+
+	ring.expiry[ring.next] = particle_time + params.lifetime;
+	ring.next = (ring.next + 1) % MAX_PARTICLE_BURSTS_PER_EFFECT;
+	ring.count++;
+}
+
+void RenderSystem::updateParticleEmitters(float elapsed_ms)
+{
+	particle_time += elapsed_ms / 1000.f;
+
+	for (uint i = 0; i < registry.particleEmitters.size(); i++) {
+		const Entity entity = registry.particleEmitters.entities[i];
+		ParticleEmitter& emitter = registry.particleEmitters.components[i];
+		if (isInactiveProjectile(entity) || !registry.positions.has(entity)) {
+			emitter.timer_ms = 0.f;
+			continue;
+		}
+
+		emitter.timer_ms += elapsed_ms;
+		if (emitter.timer_ms < emitter.interval_ms)
+			continue;
+		// a long frame still leaves only one burst behind
+		emitter.timer_ms = fmod(emitter.timer_ms, emitter.interval_ms);
+
+		// the trail drifts a little after its emitter
+		const vec2 velocity = registry.velocities.has(entity) ? registry.velocities.get(entity).velocity * 0.2f : vec2(0.f);
+		emitParticles(emitter.effect, registry.positions.get(entity).position, emitter.color, velocity);
+	}
+}
+
+void RenderSystem::extractParticles(RenderSnapshot& snapshot)
+{
+	snapshot.stats.particle_bursts = 0;
+	for (int effect = 0; effect < PARTICLE_EFFECT_COUNT; effect++) {
+		// bursts expire in the order they were emitted, so dropping them from the old end is enough
+		ParticleRing& ring = particle_rings[effect];
+		int first = (ring.next - ring.count + MAX_PARTICLE_BURSTS_PER_EFFECT) % MAX_PARTICLE_BURSTS_PER_EFFECT;
+		while (ring.count > 0 && ring.expiry[first] <= particle_time) {
+			first = (first + 1) % MAX_PARTICLE_BURSTS_PER_EFFECT;
+			ring.count--;
+		}
+		snapshot.particle_first[effect] = first;
+		snapshot.particle_count[effect] = ring.count;
+		snapshot.stats.particle_bursts += ring.count;
+	}
+
+	// in slot order the uploads come in contiguous runs
+	snapshot.new_particle_bursts.swap(emitted_particle_bursts);
+	emitted_particle_bursts.clear();
+	std::sort(snapshot.new_particle_bursts.begin(), snapshot.new_particle_bursts.end(),
+		[](const EmittedParticleBurst& a, const EmittedParticleBurst& b) { return a.slot < b.slot; });
+	snapshot.particle_time = particle_time;
+}
+
+// Copies the new bursts into the slots they were emitted into
+void RenderSystem::uploadParticleBursts(const RenderSnapshot& snapshot)
+{
+	const std::vector<EmittedParticleBurst>& bursts = snapshot.new_particle_bursts;
+	glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+	size_t begin = 0;
+	while (begin < bursts.size()) {
+		size_t end = begin + 1;
+		while (end < bursts.size() && bursts[end].slot == bursts[end - 1].slot + 1)
+			end++;
+
+		// A slot is only reused after its burst died, draws still in flight can't see anything of it by then,
+		// so there's nothing to wait for
+		const GLintptr offset = (GLintptr)(bursts[begin].slot * sizeof(ParticleBurst));
+		const GLsizeiptr size = (GLsizeiptr)((end - begin) * sizeof(ParticleBurst));
+		ParticleBurst* range = (ParticleBurst*)glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (range != nullptr) {
+			for (size_t i = begin; i < end; i++) range[i - begin] = bursts[i].burst;
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		else {
+			for (size_t i = begin; i < end; i++)
+				glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(bursts[i].slot * sizeof(ParticleBurst)), sizeof(ParticleBurst), &bursts[i].burst);
+		}
+		begin = end;
+	}
+	gl_has_errors();
+}
+
+void RenderSystem::drawParticles(const RenderSnapshot& snapshot)
+{
+	uploadParticleBursts(snapshot);
+
+	if (snapshot.stats.particle_bursts == 0)
+		return;
+
+	ShaderProgram& program = programs[(GLuint)EFFECT_ASSET_ID::PARTICLE];
+	useProgram(program);
+	program.projection.set(snapshot.projection);
+	program.time.set(snapshot.particle_time);
+	if (bound_vertex_array != particle_vertex_array) {
+		glBindVertexArray(particle_vertex_array);
+		bound_vertex_array = particle_vertex_array;
+	}
+	// sparks glow, overlapping particles get brighter
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	gl_has_errors();
+
+	for (int effect = 0; effect < PARTICLE_EFFECT_COUNT; effect++) {
+		// two triangles per particle, particle.vs.glsl builds them from gl_VertexID
+		const GLsizei vertex_count = 6 * PARTICLE_EFFECTS[effect].count;
+
+		// the live range can wrap around the end of the ring, then it is two draws
+		int first = snapshot.particle_first[effect];
+		int remaining = snapshot.particle_count[effect];
+		while (remaining > 0) {
+			const int count = std::min(remaining, MAX_PARTICLE_BURSTS_PER_EFFECT - first);
+			const size_t base = (effect * MAX_PARTICLE_BURSTS_PER_EFFECT + first) * sizeof(ParticleBurst);
+			glVertexAttribPointer(ATTRIBUTE_PARTICLE_ORIGIN, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleBurst), (void*)(base + offsetof(ParticleBurst, origin_time)));
+			glVertexAttribPointer(ATTRIBUTE_PARTICLE_VELOCITY, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleBurst), (void*)(base + offsetof(ParticleBurst, velocity)));
+			glVertexAttribPointer(ATTRIBUTE_PARTICLE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleBurst), (void*)(base + offsetof(ParticleBurst, color)));
+			glVertexAttribPointer(ATTRIBUTE_PARTICLE_SHAPE, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleBurst), (void*)(base + offsetof(ParticleBurst, shape)));
+			glDrawArraysInstanced(GL_TRIANGLES, 0, vertex_count, count);
+			stats.draw_calls++;
+			gl_has_errors();
+
+			first = (first + count) % MAX_PARTICLE_BURSTS_PER_EFFECT;
+			remaining -= count;
+		}
+	}
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl_has_errors();
+}
+
+void RenderSystem::initParticles()
+{
+	glGenBuffers(1, &particle_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particle_buffer);
+	glBufferData(GL_ARRAY_BUFFER, PARTICLE_EFFECT_COUNT * MAX_PARTICLE_BURSTS_PER_EFFECT * sizeof(ParticleBurst), nullptr, GL_DYNAMIC_DRAW);
+
+	// only per burst attributes, drawParticles points them at the live range
+	glGenVertexArrays(1, &particle_vertex_array);
+	glBindVertexArray(particle_vertex_array);
+	for (GLuint loc = ATTRIBUTE_PARTICLE_ORIGIN; loc <= ATTRIBUTE_PARTICLE_SHAPE; loc++) {
+		glEnableVertexAttribArray(loc);
+		glVertexAttribDivisor(loc, 1);
+	}
+	glBindVertexArray(0);
+	gl_has_errors();
+}
@@ -0,0 +1,153 @@
+// internal
+#include "shader_cache.hpp"
+
+// stlib
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// first bytes of every cache file, bump the version when the layout or the attribute bindings change
+static const char SHADER_CACHE_MAGIC[8] = { 'A', 'R', 'I', 'A', 'P', 'B', '0', '1' };
+
+// FNV-1a, good enough to tell sources apart
+static uint64_t hashBytes(uint64_t hash, const char* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char* text)
+{
+	return text != nullptr ? hashBytes(hash, text, strlen(text) + 1) : hash;
+}
+
+bool programBinariesSupported()
+{
+	if (gl3wProgramBinary == nullptr || gl3wGetProgramBinary == nullptr)
+		return false;
+	if (!gl3w_is_supported(4, 1) && !gl_has_extension("GL_ARB_get_program_binary"))
+		return false;
+	// some drivers expose the functions without a single format they can save in
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// glProgramBinary raises GL_INVALID_ENUM for formats the driver doesn't list, and the debug output asserts on that
+static bool binaryFormatSupported(GLenum format)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+	std::vector<GLint> formats(count);
+	if (count > 0)
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+	return std::find(formats.begin(), formats.end(), (GLint)format) != formats.end();
+}
+
+uint64_t programCacheKey(const std::string& vs_source, const std::string& fs_source)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+	hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+	hash = hashBytes(hash, vs_source.data(), vs_source.size());
+	hash = hashBytes(hash, "\0", 1);
+	hash = hashBytes(hash, fs_source.data(), fs_source.size());
+	return hash;
+}
+
+bool loadProgramBinary(const std::string& name, uint64_t key, GLuint& out_program)
+{
+	std::ifstream file(SHADER_CACHE_PATH + name + ".bin", std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	char magic[sizeof(SHADER_CACHE_MAGIC)];
+	uint64_t file_key = 0;
+	GLenum format = 0;
+	uint32_t size = 0;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&file_key, sizeof(file_key));
+	file.read((char*)&format, sizeof(format));
+	file.read((char*)&size, sizeof(size));
+	if (!file || memcmp(magic, SHADER_CACHE_MAGIC, sizeof(magic)) != 0 || file_key != key || size == 0 ||
+		!binaryFormatSupported(format))
+		return false;
+
+	std::vector<char> binary(size);
+	file.read(binary.data(), size);
+	if (!file)
+		return false;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), (GLsizei)size);
+	GLint is_linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+	if (is_linked == GL_FALSE) {
+		// drivers may refuse their own binaries, e.g. after an update that kept the version string.
+		// A refused binary of a known format only fails the link, it doesn't raise a GL error
+		glDeleteProgram(program);
+		return false;
+	}
+	out_program = program;
+	return true;
+}
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+void saveProgramBinary(const std::string& name, uint64_t key, GLuint program)
+{
+	GLint size = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return;
+	std::vector<char> binary(size);
+	GLenum format = 0;
+	glGetProgramBinary(program, size, nullptr, &format, binary.data());
+	gl_has_errors();
+
+	makeDirectory(SHADER_CACHE_PATH); // fails harmlessly if it exists
+	std::ofstream file(SHADER_CACHE_PATH + name + ".bin", std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		fprintf(stderr, "Could not write the program binary of %s to %s\n", name.c_str(), SHADER_CACHE_PATH.c_str());
+		return;
+	}
+	const uint32_t binary_size = (uint32_t)size;
+	file.write(SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+	file.write((const char*)&key, sizeof(key));
+	file.write((const char*)&format, sizeof(format));
+	file.write((const char*)&binary_size, sizeof(binary_size));
+	file.write(binary.data(), size);
+}
+
+bool enableParallelShaderCompile()
+{
+	// 0xFFFFFFFF leaves the number of threads to the driver
+	if (gl3wMaxShaderCompilerThreadsKHR != nullptr && gl_has_extension("GL_KHR_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		return true;
+	}
+	if (gl3wMaxShaderCompilerThreadsARB != nullptr && gl_has_extension("GL_ARB_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+#include "common.hpp"
+
+// Linked programs of the last launch, one file per effect, see RenderSystem::initializeGlEffects
+const std::string SHADER_CACHE_PATH = data_path() + "/shader_cache/";
+
+// Whether the driver can hand out program binaries at all (GL 4.1 or GL_ARB_get_program_binary)
+bool programBinariesSupported();
+
+// Hash of both sources and the driver's vendor, renderer and version string.
+// A binary is only valid for the driver that produced it, an update makes every file miss.
+uint64_t programCacheKey(const std::string& vs_source, const std::string& fs_source);
+
+// Creates out_program from the effect's cached binary, false (and no program) if there is none for this key
+// or the driver rejects it
+bool loadProgramBinary(const std::string& name, uint64_t key, GLuint& out_program);
+// The program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+void saveProgramBinary(const std::string& name, uint64_t key, GLuint program);
+
+// Lets the driver compile on its own threads if it has GL_KHR_parallel_shader_compile (or the ARB version),
+// compiles then only block once their status is queried
+bool enableParallelShaderCompile();
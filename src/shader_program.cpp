@@ -0,0 +1,101 @@
+// internal
+#include "shader_program.hpp"
+
+// stlib
+#include <cstring>
+#include <utility>
+
+// GLSL names of the reflected uniforms
+static const std::pair<const char*, ShaderUniform ShaderProgram::*> UNIFORM_NAMES[] = {
+	{ "transform", &ShaderProgram::transform },
+	{ "projection", &ShaderProgram::projection },
+	{ "fcolor", &ShaderProgram::fcolor },
+	{ "sampler0", &ShaderProgram::sampler0 },
+	{ "time", &ShaderProgram::time },
+	{ "change", &ShaderProgram::change },
+	{ "light_radius", &ShaderProgram::light_radius },
+	{ "window_size", &ShaderProgram::window_size },
+	{ "radius", &ShaderProgram::radius },
+	{ "apply_spotlight", &ShaderProgram::apply_spotlight },
+	{ "screen_darken_factor", &ShaderProgram::screen_darken_factor },
+	{ "light_map", &ShaderProgram::light_map },
+	{ "render_scale", &ShaderProgram::render_scale },
+	{ "light_position", &ShaderProgram::light_position },
+	{ "chunk_table", &ShaderProgram::chunk_table },
+	{ "chunk_atlas", &ShaderProgram::chunk_atlas },
+	{ "tile_palette", &ShaderProgram::tile_palette },
+	{ "map_origin", &ShaderProgram::map_origin },
+	{ "cell_size", &ShaderProgram::cell_size },
+	{ "chunk_slots_per_row", &ShaderProgram::chunk_slots_per_row },
+};
+
+bool ShaderUniform::changed(const void* value, size_t bytes)
+{
+	if (location < 0)
+		return false;
+	if (cached && memcmp(cache, value, bytes) == 0)
+		return false;
+	memcpy(cache, value, bytes);
+	cached = true;
+	return true;
+}
+
+void ShaderUniform::set(int value)
+{
+	if (changed(&value, sizeof(value))) glUniform1i(location, value);
+}
+
+void ShaderUniform::set(float value)
+{
+	if (changed(&value, sizeof(value))) glUniform1f(location, value);
+}
+
+void ShaderUniform::set(vec2 value)
+{
+	if (changed(&value, sizeof(value))) glUniform2fv(location, 1, (float*)&value);
+}
+
+void ShaderUniform::set(vec3 value)
+{
+	if (changed(&value, sizeof(value))) glUniform3fv(location, 1, (float*)&value);
+}
+
+void ShaderUniform::set(vec4 value)
+{
+	if (changed(&value, sizeof(value))) glUniform4fv(location, 1, (float*)&value);
+}
+
+void ShaderUniform::set(const mat3& value)
+{
+	if (changed(&value, sizeof(value))) glUniformMatrix3fv(location, 1, GL_FALSE, (float*)&value);
+}
+
+void ShaderUniform::set(const mat4& value)
+{
+	if (changed(&value, sizeof(value))) glUniformMatrix4fv(location, 1, GL_FALSE, (float*)&value);
+}
+
+void ShaderProgram::reflect(GLuint program)
+{
+	handle = program;
+
+	GLint count = 0;
+	GLint max_length = 0;
+	GLint size = 0;
+	GLenum type = 0;
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<GLchar> name(max_length + 1);
+	for (GLint i = 0; i < count; i++) {
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+		for (const auto& uniform : UNIFORM_NAMES) {
+			if (strcmp(uniform.first, name.data()) == 0) {
+				ShaderUniform& target = this->*uniform.second;
+				target.location = glGetUniformLocation(program, name.data());
+				target.invalidate();
+			}
+		}
+	}
+	gl_has_errors();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common.hpp"
+
+// A uniform of one program. The last uploaded value is remembered, so setting the value a uniform
+// already has is a memcmp instead of a driver call. The owning program has to be bound when setting.
+class ShaderUniform
+{
+public:
+	GLint location = -1; // -1 if the program doesn't use it, setting is then a no-op
+
+	void set(int value);
+	void set(float value);
+	void set(vec2 value);
+	void set(vec3 value);
+	void set(vec4 value);
+	void set(const mat3& value);
+	void set(const mat4& value);
+
+	// forget the cached value, e.g. after the program was relinked
+	void invalidate() { cached = false; }
+
+private:
+	// copies the value into the cache and returns whether it differs from the last upload
+	bool changed(const void* value, size_t bytes);
+
+	bool cached = false;
+	unsigned char cache[sizeof(mat4)];
+};
+
+// Uniform locations of one effect, reflected once after linking. Anything a program doesn't declare
+// (or the compiler optimized away) stays at -1. Attributes use the fixed locations of render_system.hpp.
+struct ShaderProgram
+{
+	GLuint handle = 0;
+
+	// shared by most sprite effects
+	ShaderUniform transform;
+	ShaderUniform projection;
+	ShaderUniform fcolor;
+	ShaderUniform sampler0;
+	ShaderUniform time;
+	// aria
+	ShaderUniform change;
+	// screen_darken
+	ShaderUniform light_radius;
+	ShaderUniform window_size;
+	ShaderUniform radius;
+	ShaderUniform apply_spotlight;
+	ShaderUniform screen_darken_factor;
+	ShaderUniform light_map;
+	ShaderUniform render_scale;
+	// shadow
+	ShaderUniform light_position;
+	// tile_map
+	ShaderUniform chunk_table;
+	ShaderUniform chunk_atlas;
+	ShaderUniform tile_palette;
+	ShaderUniform map_origin;
+	ShaderUniform cell_size;
+	ShaderUniform chunk_slots_per_row;
+
+	// query the active uniforms of a linked program
+	void reflect(GLuint program);
+};
@@ -0,0 +1,171 @@
+// internal
+#include "texture_atlas.hpp"
+
+// stlib
+#include <algorithm>
+#include <fstream>
+
+void SkylinePacker::init(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	used = { 0, 0 };
+	skyline.clear();
+	skyline.push_back({ 0, 0, width });
+}
+
+int SkylinePacker::fit(size_t index, ivec2 size) const
+{
+	int x = skyline[index].x;
+	if (x + size.x > width)
+		return -1;
+	int y = skyline[index].y;
+	int width_left = size.x;
+	for (size_t i = index; width_left > 0; i++) {
+		y = std::max(y, skyline[i].y);
+		if (y + size.y > height)
+			return -1;
+		width_left -= skyline[i].width;
+	}
+	return y;
+}
+
+bool SkylinePacker::insert(ivec2 size, ivec2& origin)
+{
+	int best_index = -1;
+	int best_bottom = height + 1;
+	int best_width = width + 1;
+	for (size_t i = 0; i < skyline.size(); i++) {
+		int y = fit(i, size);
+		if (y < 0) continue;
+		// lowest resting place first, narrower segments break ties so wide gaps stay open
+		if (y + size.y < best_bottom || (y + size.y == best_bottom && skyline[i].width < best_width)) {
+			best_index = (int)i;
+			best_bottom = y + size.y;
+			best_width = skyline[i].width;
+		}
+	}
+	if (best_index < 0)
+		return false;
+
+	origin = { skyline[best_index].x, best_bottom - size.y };
+	skyline.insert(skyline.begin() + best_index, { origin.x, best_bottom, size.x });
+
+	// cut away the segments now covered by the new one
+	for (size_t i = best_index + 1; i < skyline.size();) {
+		const Segment& previous = skyline[i - 1];
+		int overlap = previous.x + previous.width - skyline[i].x;
+		if (overlap <= 0) break;
+		skyline[i].x += overlap;
+		skyline[i].width -= overlap;
+		if (skyline[i].width > 0) break;
+		skyline.erase(skyline.begin() + i);
+	}
+	// merge neighbours of equal height
+	for (size_t i = 1; i < skyline.size();) {
+		if (skyline[i - 1].y == skyline[i].y) {
+			skyline[i - 1].width += skyline[i].width;
+			skyline.erase(skyline.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+
+	used = max(used, origin + size);
+	return true;
+}
+
+AtlasLayout packTextureAtlases(const std::vector<ivec2>& sizes, const std::vector<bool>& packable, int max_size)
+{
+	AtlasLayout layout;
+	layout.max_size = max_size;
+	layout.placements.resize(sizes.size());
+
+	// tall images first, the skyline stays flatter that way
+	std::vector<size_t> order;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		if (packable[i]) order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+		if (sizes[a].y != sizes[b].y) return sizes[a].y > sizes[b].y;
+		return sizes[a].x > sizes[b].x;
+	});
+
+	std::vector<SkylinePacker> packers;
+	for (size_t i : order) {
+		ivec2 padded = sizes[i] + ivec2(TEXTURE_ATLAS_PADDING);
+		if (padded.x > max_size || padded.y > max_size) continue;
+
+		AtlasPlacement& placement = layout.placements[i];
+		for (size_t atlas = 0; atlas < packers.size(); atlas++) {
+			if (packers[atlas].insert(padded, placement.origin)) {
+				placement.atlas = (int)atlas;
+				break;
+			}
+		}
+		if (placement.atlas < 0) {
+			packers.emplace_back();
+			packers.back().init(max_size, max_size);
+			packers.back().insert(padded, placement.origin);
+			placement.atlas = (int)packers.size() - 1;
+		}
+	}
+
+	for (const SkylinePacker& packer : packers) {
+		layout.atlas_sizes.push_back(packer.usedSize());
+	}
+	return layout;
+}
+
+bool loadAtlasLayout(const std::string& path, const std::vector<std::string>& names,
+	const std::vector<ivec2>& sizes, int max_size, AtlasLayout& layout)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		return false;
+
+	std::string tag;
+	size_t atlas_count = 0;
+	size_t image_count = 0;
+	file >> tag >> layout.max_size >> atlas_count >> image_count;
+	if (!file || tag != "atlas_layout" || layout.max_size != max_size || image_count != names.size())
+		return false;
+
+	layout.atlas_sizes.resize(atlas_count);
+	for (ivec2& atlas_size : layout.atlas_sizes) {
+		file >> atlas_size.x >> atlas_size.y;
+	}
+
+	layout.placements.resize(image_count);
+	for (size_t i = 0; i < image_count; i++) {
+		ivec2 size;
+		AtlasPlacement& placement = layout.placements[i];
+		file >> size.x >> size.y >> placement.atlas >> placement.origin.x >> placement.origin.y >> std::ws;
+		std::string name;
+		std::getline(file, name);
+		if (!file || name != names[i] || size != sizes[i] || placement.atlas >= (int)atlas_count)
+			return false;
+	}
+	return true;
+}
+
+void saveAtlasLayout(const std::string& path, const std::vector<std::string>& names,
+	const std::vector<ivec2>& sizes, const AtlasLayout& layout)
+{
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		fprintf(stderr, "Could not write the atlas layout to %s\n", path.c_str());
+		return;
+	}
+
+	file << "atlas_layout " << layout.max_size << " " << layout.atlas_sizes.size() << " " << names.size() << "\n";
+	for (ivec2 atlas_size : layout.atlas_sizes) {
+		file << atlas_size.x << " " << atlas_size.y << "\n";
+	}
+	for (size_t i = 0; i < names.size(); i++) {
+		const AtlasPlacement& placement = layout.placements[i];
+		file << sizes[i].x << " " << sizes[i].y << " " << placement.atlas << " "
+			<< placement.origin.x << " " << placement.origin.y << " " << names[i] << "\n";
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+// upper bound of an atlas side, clamped to GL_MAX_TEXTURE_SIZE at startup
+const int TEXTURE_ATLAS_MAX_SIZE = 2048;
+// transparent gap between packed images so linear filtering doesn't bleed neighbours into each other
+const int TEXTURE_ATLAS_PADDING = 2;
+
+// Where one image ended up, atlas is -1 if the image keeps its own texture
+struct AtlasPlacement {
+	int atlas = -1;
+	ivec2 origin = { 0, 0 };
+};
+
+struct AtlasLayout {
+	int max_size = 0;                      // atlas side the layout was packed for
+	std::vector<ivec2> atlas_sizes;        // used extent of every atlas
+	std::vector<AtlasPlacement> placements; // one per image, in input order
+};
+
+// Skyline bin packer, the top edge of the packed area is kept as a list of horizontal segments
+// and every image is put where it ends up lowest (bottom-left rule)
+class SkylinePacker
+{
+public:
+	void init(int width, int height);
+
+	// false if the rectangle doesn't fit anymore
+	bool insert(ivec2 size, ivec2& origin);
+
+	// bounding box of everything packed so far
+	ivec2 usedSize() const { return used; }
+
+private:
+	struct Segment {
+		int x;
+		int y;
+		int width;
+	};
+	// y at which a rectangle of the given width rests when placed at segment index, -1 if it doesn't fit
+	int fit(size_t index, ivec2 size) const;
+
+	int width = 0;
+	int height = 0;
+	ivec2 used = { 0, 0 };
+	std::vector<Segment> skyline;
+};
+
+// Packs every image flagged as packable into as few atlases as needed, largest images first.
+// Images that don't fit into an empty atlas are left unpacked.
+AtlasLayout packTextureAtlases(const std::vector<ivec2>& sizes, const std::vector<bool>& packable, int max_size);
+
+// The layout only depends on the image names and sizes, so it can be reused as long as neither changed.
+// Returns false if there is no cache or it is stale.
+bool loadAtlasLayout(const std::string& path, const std::vector<std::string>& names,
+	const std::vector<ivec2>& sizes, int max_size, AtlasLayout& layout);
+void saveAtlasLayout(const std::string& path, const std::vector<std::string>& names,
+	const std::vector<ivec2>& sizes, const AtlasLayout& layout);
@@ -0,0 +1,64 @@
+// internal
+#include "tile_map.hpp"
+
+// stlib
+#include <algorithm>
+#include <cfloat>
+
+static int gcd(int a, int b)
+{
+	while (b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+void TileMap::build(const std::vector<vec4>& rects)
+{
+	chunk_slots.clear();
+	chunks.clear();
+	tile_origins.clear();
+	chunk_count = { 0, 0 };
+
+	const size_t tile_count = std::min(rects.size(), TILE_MAP_MAX_TILES);
+	if (tile_count == 0)
+		return;
+
+	// largest cell that every floor edge falls on
+	vec2 bounds_min = { FLT_MAX, FLT_MAX };
+	vec2 bounds_max = { -FLT_MAX, -FLT_MAX };
+	int cell = 0;
+	for (size_t i = 0; i < tile_count; i++) {
+		bounds_min = min(bounds_min, vec2(rects[i].x, rects[i].y));
+		bounds_max = max(bounds_max, vec2(rects[i].z, rects[i].w));
+		for (int k = 0; k < 4; k++) {
+			cell = gcd(cell, abs((int)round(rects[i][k])));
+		}
+	}
+	cell_size = (float)std::max(cell, TILE_MAP_MIN_CELL_SIZE);
+	origin = floor(bounds_min / cell_size) * cell_size;
+
+	const ivec2 cell_count = ivec2(ceil((bounds_max - origin) / cell_size));
+	chunk_count = (cell_count + TILE_MAP_CHUNK_SIZE - 1) / TILE_MAP_CHUNK_SIZE;
+	chunk_slots.assign(chunk_count.x * chunk_count.y, -1);
+
+	for (size_t i = 0; i < tile_count; i++) {
+		const uint8_t tile = (uint8_t)(i + 1);
+		tile_origins.push_back(vec2(rects[i].x, rects[i].y));
+
+		const ivec2 first = ivec2(round((vec2(rects[i].x, rects[i].y) - origin) / cell_size));
+		const ivec2 last = ivec2(round((vec2(rects[i].z, rects[i].w) - origin) / cell_size)) - 1;
+		for (int y = first.y; y <= last.y; y++) {
+			for (int x = first.x; x <= last.x; x++) {
+				const int chunk = (y / TILE_MAP_CHUNK_SIZE) * chunk_count.x + x / TILE_MAP_CHUNK_SIZE;
+				if (chunk_slots[chunk] < 0) {
+					chunk_slots[chunk] = (int)chunks.size();
+					chunks.emplace_back(TILE_MAP_CHUNK_SIZE * TILE_MAP_CHUNK_SIZE, 0);
+				}
+				chunks[chunk_slots[chunk]][(y % TILE_MAP_CHUNK_SIZE) * TILE_MAP_CHUNK_SIZE + x % TILE_MAP_CHUNK_SIZE] = tile;
+			}
+		}
+	}
+}
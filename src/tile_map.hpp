@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+
+// cells per side of a chunk, only chunks that contain tiles are stored
+const int TILE_MAP_CHUNK_SIZE = 64;
+// floors snap to cells no smaller than this, the cell size is otherwise picked so every floor edge lies on one
+const int TILE_MAP_MIN_CELL_SIZE = 5;
+// tile ids are stored in 8 bits, 0 is empty
+const size_t TILE_MAP_MAX_TILES = 255;
+
+// Tile-index grid over the level's floors, sampled per pixel by tile_map.fs.glsl.
+// Every cell holds the id of the topmost floor covering it. A tile id looks up where its texture starts
+// repeating, so the pattern lines up exactly like the stretched repeat quads it replaces.
+// The grid is chunked: a chunk table points into a list of chunks, and empty chunks cost one table entry.
+class TileMap
+{
+public:
+	// rects are (min x, min y, max x, max y) in world coordinates, later rects cover earlier ones.
+	// Tile ids are assigned in order, rects beyond TILE_MAP_MAX_TILES are ignored.
+	void build(const std::vector<vec4>& rects);
+
+	bool empty() const { return chunks.empty(); }
+
+	float cell_size = 1.f;
+	vec2 origin = { 0.f, 0.f };   // world position of the corner of cell (0, 0)
+	ivec2 chunk_count = { 0, 0 }; // chunks per side of the table
+	std::vector<int> chunk_slots; // per chunk of the table, index into chunks or -1
+	std::vector<std::vector<uint8_t>> chunks; // TILE_MAP_CHUNK_SIZE^2 tile ids, row major
+	std::vector<vec2> tile_origins; // per tile id - 1, world position the floor texture repeats from
+};
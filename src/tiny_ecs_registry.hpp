@@ -24,22 +24,26 @@ public:
 	ComponentContainer<Follower> followers;
 	ComponentContainer<SecondaryFollower> secondaryFollowers;
 	ComponentContainer<Text> texts;
+	ComponentContainer<TextLayout> textLayouts;
 	ComponentContainer<InvulnerableTimer> invulnerableTimers;
 	ComponentContainer<Position> positions;
 	ComponentContainer<Velocity> velocities;
 	ComponentContainer<Floor> floors;
+	ComponentContainer<Baked> baked;
+	ComponentContainer<StaticGeometry> staticGeometries;
 	ComponentContainer<Direction> directions;
 	ComponentContainer<Collision> collisions;
 	ComponentContainer<Collidable> collidables;
 	ComponentContainer<Player> players;
 	ComponentContainer<Enemy> enemies;
 	ComponentContainer<Boss> bosses;
+	ComponentContainer<AIUpdate> aiUpdates;
 	ComponentContainer<LostSoul> lostSouls;
 	ComponentContainer<PowerUp> powerUps;
 	ComponentContainer<PowerUpBlock> powerUpBlocks;
 	ComponentContainer<Terrain> terrain;
 	ComponentContainer<HealthPack> healthPacks;
-	ComponentContainer<Shadow> shadows;
+	ComponentContainer<CastsShadow> castsShadows;
 	ComponentContainer<ExitDoor> exitDoors;
 	ComponentContainer<LifeOrb> lifeOrbs;
 	ComponentContainer<Cutscene> cutscenes;
@@ -48,6 +52,8 @@ public:
 	ComponentContainer<Animation> animations;
 	ComponentContainer<RenderRequest> renderRequests;
 	ComponentContainer<ScreenState> screenStates;
+	ComponentContainer<LightSource> lightSources;
+	ComponentContainer<ParticleEmitter> particleEmitters;
 	ComponentContainer<DebugComponent> debugComponents;
 	ComponentContainer<vec3> colors;
 	ComponentContainer<Obstacle> obstacles;
@@ -60,6 +66,7 @@ public:
 		registry_list.push_back(&weaknessTimers);
 		registry_list.push_back(&projectiles);
 		registry_list.push_back(&texts);
+		registry_list.push_back(&textLayouts);
 		registry_list.push_back(&resources);
 		registry_list.push_back(&healthBars);
 		registry_list.push_back(&manaBars);
@@ -72,18 +79,21 @@ public:
 		registry_list.push_back(&positions);
 		registry_list.push_back(&velocities);
 		registry_list.push_back(&floors);
+		registry_list.push_back(&baked);
+		registry_list.push_back(&staticGeometries);
 		registry_list.push_back(&directions);
 		registry_list.push_back(&collisions);
 		registry_list.push_back(&collidables);
 		registry_list.push_back(&players);
 		registry_list.push_back(&enemies);
 		registry_list.push_back(&bosses);
+		registry_list.push_back(&aiUpdates);
 		registry_list.push_back(&lostSouls);
 		registry_list.push_back(&powerUps);
 		registry_list.push_back(&powerUpBlocks);
 		registry_list.push_back(&terrain);
 		registry_list.push_back(&healthPacks);
-		registry_list.push_back(&shadows);
+		registry_list.push_back(&castsShadows);
 		registry_list.push_back(&exitDoors);
 		registry_list.push_back(&lifeOrbs);
 		registry_list.push_back(&cutscenes);
@@ -92,6 +102,8 @@ public:
 		registry_list.push_back(&animations);
 		registry_list.push_back(&renderRequests);
 		registry_list.push_back(&screenStates);
+		registry_list.push_back(&lightSources);
+		registry_list.push_back(&particleEmitters);
 		registry_list.push_back(&debugComponents);
 		registry_list.push_back(&colors);
 		registry_list.push_back(&obstacles);
@@ -146,7 +146,7 @@ Entity createObstacle(RenderSystem* renderer, vec2 pos, vec2 size, vec2 vel) {
 	Obstacle& obstacle = registry.obstacles.emplace(entity);
 	registry.collidables.emplace(entity); // Marking obstacle as collidable
 
-	createShadow(renderer, entity, TEXTURE_ASSET_ID::GHOST, GEOMETRY_BUFFER_ID::SPRITE);
+	addShadow(entity, TEXTURE_ASSET_ID::GHOST, GEOMETRY_BUFFER_ID::SPRITE);
 
 	registry.renderRequests.insert(
 		entity,
@@ -183,7 +183,7 @@ Entity createLostSoul(RenderSystem* renderer, vec2 pos) {
 
 	registry.collidables.emplace(entity); // Marking obstacle as collidable
 
-	createShadow(renderer, entity, TEXTURE_ASSET_ID::LOST_SOUL, GEOMETRY_BUFFER_ID::SPRITE);
+	addShadow(entity, TEXTURE_ASSET_ID::LOST_SOUL, GEOMETRY_BUFFER_ID::SPRITE);
 
 	//flag to render
 	if (registry.cutscenes.size() > 0 && registry.cutscenes.components[0].is_cutscene_6) return entity;
@@ -213,6 +213,7 @@ Entity createEnemy(RenderSystem* renderer, vec2 pos, Enemy enemyAttributes)
 
 	Enemy& enemy = registry.enemies.emplace(entity);
 	enemy = enemyAttributes;
+	registry.aiUpdates.emplace(entity);
 	
 	TEXTURE_ASSET_ID texture_asset;
 	TEXTURE_ASSET_ID shadow_texture_asset;
@@ -266,7 +267,7 @@ Entity createEnemy(RenderSystem* renderer, vec2 pos, Enemy enemyAttributes)
 
 	position.scale = vec2({ scale_factor * sprite_sheet.frame_width, scale_factor * sprite_sheet.frame_height });
 
-	createShadow(renderer, entity, shadow_texture_asset, GEOMETRY_BUFFER_ID::SPRITE);
+	addShadow(entity, shadow_texture_asset, GEOMETRY_BUFFER_ID::SPRITE);
 
 	registry.collidables.emplace(entity);
 	registry.renderRequests.insert(
@@ -306,6 +307,7 @@ Entity createBoss(RenderSystem* renderer, vec2 pos, Enemy enemyAttributes)
 
 	Enemy& enemy = registry.enemies.emplace(entity);
 	enemy = enemyAttributes;
+	registry.aiUpdates.emplace(entity);
 
 	TEXTURE_ASSET_ID textureAsset;
 	TEXTURE_ASSET_ID shadowTextureAsset;
@@ -379,7 +381,7 @@ Entity createBoss(RenderSystem* renderer, vec2 pos, Enemy enemyAttributes)
 		position.scale = vec2({ 3.f * sprite_sheet.frame_width, 3.f * sprite_sheet.frame_height });
 	}
 	
-	createShadow(renderer, entity, shadowTextureAsset, GEOMETRY_BUFFER_ID::SPRITE);
+	addShadow(entity, shadowTextureAsset, GEOMETRY_BUFFER_ID::SPRITE);
 
 	registry.collidables.emplace(entity);
 	registry.renderRequests.insert(
@@ -547,30 +549,11 @@ Entity createHealthPack(RenderSystem* renderer, vec2 pos)
 	return entity;
 }
 
-Entity createShadow(RenderSystem* renderer, Entity& owner_entity, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geom)
+void addShadow(Entity owner_entity, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geom)
 {
-	auto entity = Entity();
-
-	Shadow& shadow = registry.shadows.emplace(entity);
-	shadow.owner = owner_entity;
-	shadow.active = false;
-
-	Mesh& mesh = renderer->getMesh(geom);
-	registry.meshPtrs.emplace(entity, &mesh);
-
-	Position& owner_position = registry.positions.get(owner_entity);
-	Position& position = registry.positions.emplace(entity);
-	position.position = owner_position.position;
-	position.scale = owner_position.scale;
-	shadow.original_size = position.scale;
-
-	registry.renderRequests.insert(
-		entity,
-		{ texture,
-			EFFECT_ASSET_ID::SHADOW,
-			geom });
-
-	return entity;
+	CastsShadow& casts_shadow = registry.castsShadows.emplace(owner_entity);
+	casts_shadow.texture = texture;
+	casts_shadow.geometry = geom;
 }
 
 Entity createProjectileSelectDisplay(RenderSystem* renderer, Entity& owner_entity, float x_offset, float y_offset)
@@ -739,62 +722,103 @@ Entity createTestSalmon(RenderSystem* renderer, vec2 pos)
 Entity createProjectile(RenderSystem* renderer, vec2 pos, vec2 vel, ElementType elementType, bool hostile, Entity& player) {
 	auto entity = Entity();
 
-	Projectile& projectile = registry.projectiles.emplace(entity);
+	// Every component a projectile can need is emplaced once here so that the projectile pool can
+	// recycle the entity later by only overwriting values (see resetProjectile)
+	registry.projectiles.emplace(entity);
+	registry.meshPtrs.emplace(entity, nullptr);
+	registry.spriteSheetPtrs.emplace(entity, nullptr);
+	registry.animations.emplace(entity);
+	registry.velocities.emplace(entity);
+	registry.positions.emplace(entity);
+	registry.collidables.emplace(entity);
+	registry.lightSources.emplace(entity);
+	registry.particleEmitters.emplace(entity);
+	registry.renderRequests.insert(
+		entity,
+		{	TEXTURE_ASSET_ID::WATER_PROJECTILE_SHEET,
+			EFFECT_ASSET_ID::ANIMATED,
+			GEOMETRY_BUFFER_ID::WATER_PROJECTILE });
+
+	resetProjectile(renderer, entity, pos, vel, elementType, hostile, player);
+	return entity;
+}
+
+void resetProjectile(RenderSystem* renderer, Entity entity, vec2 pos, vec2 vel, ElementType elementType, bool hostile, Entity& player) {
+	Projectile& projectile = registry.projectiles.get(entity);
+	projectile = Projectile();
 	projectile.type = elementType;
 	projectile.hostile = hostile;
 
 	TEXTURE_ASSET_ID textureAsset;
 	GEOMETRY_BUFFER_ID geometryBuffer;
 	SPRITE_SHEET_DATA_ID spriteSheet;
+	vec3 glow;
 	switch (projectile.type) {
 		case ElementType::WATER:
 			textureAsset = TEXTURE_ASSET_ID::WATER_PROJECTILE_SHEET;
 			geometryBuffer = GEOMETRY_BUFFER_ID::WATER_PROJECTILE;
 			spriteSheet = SPRITE_SHEET_DATA_ID::WATER_PROJECTILE;
+			glow = { 0.3f, 0.5f, 1.f };
 			break;
 		case ElementType::FIRE:
 			textureAsset = TEXTURE_ASSET_ID::FIRE_PROJECTILE_SHEET;
 			geometryBuffer = GEOMETRY_BUFFER_ID::FIRE_PROJECTILE;
 			spriteSheet = SPRITE_SHEET_DATA_ID::FIRE_PROJECTILE;
+			glow = { 1.f, 0.5f, 0.2f };
 			break;
 		case ElementType::EARTH:
 			textureAsset = TEXTURE_ASSET_ID::EARTH_PROJECTILE_SHEET;
 			geometryBuffer = GEOMETRY_BUFFER_ID::EARTH_PROJECTILE_SHEET;
 			spriteSheet = SPRITE_SHEET_DATA_ID::EARTH_PROJECTILE_SHEET;
+			glow = { 0.5f, 0.8f, 0.3f };
 			break;
 		case ElementType::LIGHTNING:
 			textureAsset = TEXTURE_ASSET_ID::LIGHTNING_PROJECTILE_SHEET;
 			geometryBuffer = GEOMETRY_BUFFER_ID::LIGHTNING_PROJECTILE_SHEET;
 			spriteSheet = SPRITE_SHEET_DATA_ID::LIGHTNING_PROJECTILE_SHEET;
+			glow = { 1.f, 1.f, 0.5f };
 			break;
 		default:
 			textureAsset = TEXTURE_ASSET_ID::WATER_PROJECTILE_SHEET;
 			geometryBuffer = GEOMETRY_BUFFER_ID::WATER_PROJECTILE;
 			spriteSheet = SPRITE_SHEET_DATA_ID::WATER_PROJECTILE;
+			glow = { 0.3f, 0.5f, 1.f };
 			break;
 	}
 
+	// projectiles glow in the color of their element
+	LightSource& light = registry.lightSources.get(entity);
+	light.radius = 60.f;
+	light.color = glow;
+	light.intensity = 0.5f;
+
+	// and leave a trail of it behind
+	ParticleEmitter& emitter = registry.particleEmitters.get(entity);
+	emitter = ParticleEmitter();
+	emitter.color = glow;
+
 	// Store a reference to the potentially re-used mesh object (the value is stored in the resource cache)
 	Mesh& mesh = renderer->getMesh(geometryBuffer);
-	registry.meshPtrs.emplace(entity, &mesh);
+	registry.meshPtrs.get(entity) = &mesh;
 
 	SpriteSheet& sprite_sheet = renderer->getSpriteSheet(spriteSheet);
-	registry.spriteSheetPtrs.emplace(entity, &sprite_sheet);
+	registry.spriteSheetPtrs.get(entity) = &sprite_sheet;
 
-	Animation& animation = registry.animations.emplace(entity);
+	Animation& animation = registry.animations.get(entity);
+	animation = Animation();
 	animation.sprite_sheet_ptr = &sprite_sheet;
 	animation.setState((int)PROJECTILE_STATES::MOVING);
 
-	Velocity& velocity = registry.velocities.emplace(entity);
+	Velocity& velocity = registry.velocities.get(entity);
 	velocity.velocity = vel;
 
 	// Set initial position and velocity for the projectile
-	Position& position = registry.positions.emplace(entity);
+	Position& position = registry.positions.get(entity);
 	position.position = pos;
+	position.prev_position = pos;
 	position.angle = atan2(vel.y, vel.x);
 	position.scale = vec2(sprite_sheet.frame_width, sprite_sheet.frame_height);
 
-	registry.collidables.emplace(entity);
   if (!hostile) {
 	  PowerUp& powerUp = registry.powerUps.get(player);
 	  if (powerUp.tripleShot[elementType]) projectile.damage *= 0.5f; // triple shot projectiles are decreased damage
@@ -802,15 +826,12 @@ Entity createProjectile(RenderSystem* renderer, vec2 pos, vec2 vel, ElementType
 	  if (powerUp.bounceOffWalls[elementType]) projectile.bounces = 2; // allow 2 bounces off walls
   }
 
-	registry.renderRequests.insert(
-		entity,
-		{	textureAsset,
-			EFFECT_ASSET_ID::ANIMATED,
-			geometryBuffer });
-	return entity;
+	RenderRequest& render_request = registry.renderRequests.get(entity);
+	render_request.used_texture = textureAsset;
+	render_request.used_geometry = geometryBuffer;
 }
 
-Entity createText(std::string in_text, vec2 pos, float scale, vec3 color)
+Entity createText(std::string in_text, vec2 pos, float scale, vec3 color, vec4 outline, vec4 glow)
 {
 	Entity entity = Entity();
 
@@ -821,11 +842,15 @@ Entity createText(std::string in_text, vec2 pos, float scale, vec3 color)
 	Text& text = registry.texts.emplace(entity);
 	text.text = in_text;
 	text.color = color;
+	text.outline = outline;
+	text.glow = glow;
 
+	// only pay for the effects when there are any
+	const bool has_effects = outline.w > 0.f || glow.w > 0.f;
 	registry.renderRequests.insert(
 		entity,
 		{ TEXTURE_ASSET_ID::TEXTURE_COUNT,
-			EFFECT_ASSET_ID::TEXT_2D,
+			has_effects ? EFFECT_ASSET_ID::TEXT_2D_EFFECTS : EFFECT_ASSET_ID::TEXT_2D,
 			GEOMETRY_BUFFER_ID::TEXT_2D });
 
 	return entity;
@@ -860,6 +885,11 @@ Entity createLifeOrb(RenderSystem* renderer, vec2 pos, int piece_number) {
 
 	LifeOrb& life_orb = registry.lifeOrbs.emplace(entity);
 
+	LightSource& light = registry.lightSources.emplace(entity);
+	light.radius = 250.f;
+	light.color = { 1.f, 0.9f, 0.7f };
+	light.intensity = 0.8f;
+
 	Position& position = registry.positions.emplace(entity);
 	position.position = pos;
 	
@@ -23,6 +23,8 @@ const float BOSS_BAR_HEIGHT = 9.f;
 // the player
 Entity createAria(RenderSystem* renderer, vec2 pos);
 Entity createProjectile(RenderSystem* renderer, vec2 pos, vec2 vel, ElementType elementType, bool hostile, Entity& player);
+// re-initializes an existing projectile entity in place (used by the projectile pool)
+void resetProjectile(RenderSystem* renderer, Entity entity, vec2 pos, vec2 vel, ElementType elementType, bool hostile, Entity& player);
 // a red line for debugging purposes
 Entity createLine(vec2 position, vec2 size);
 
@@ -32,7 +34,8 @@ Entity createTerrain(RenderSystem* renderer, vec2 pos, vec2 size, DIRECTION dir,
 // creates an exit door
 Entity createExitDoor(RenderSystem* renderer, vec2 pos);
 
-Entity createText(std::string in_text, vec2 pos, float scale, vec3 color);
+// outline and glow are rgb plus width, see Text
+Entity createText(std::string in_text, vec2 pos, float scale, vec3 color, vec4 outline = vec4(0.f), vec4 glow = vec4(0.f));
 
 // creates a power up block
 Entity createPowerUpBlock(RenderSystem* renderer, pair<string, bool*>* powerUp, vec2 pos);
@@ -66,7 +69,8 @@ Entity createFloor(RenderSystem* renderer, vec2 pos, vec2 size);
 
 Entity createHealthPack(RenderSystem* renderer, vec2 pos);
 
-Entity createShadow(RenderSystem* renderer, Entity& owner_entity, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geom);
+// the owner casts a shadow drawn with the given texture and geometry
+void addShadow(Entity owner_entity, TEXTURE_ASSET_ID texture, GEOMETRY_BUFFER_ID geom);
 
 // test entity
 Entity createTestSalmon(RenderSystem* renderer, vec2 pos);
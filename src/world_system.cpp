@@ -1,6 +1,7 @@
 // Header
 #include "world_system.hpp"
 #include "world_init.hpp"
+#include "projectile_pool.hpp"
 #include "utils.hpp"
 
 // stlib
@@ -29,6 +30,9 @@ WorldSystem::WorldSystem() {
 }
 
 WorldSystem::~WorldSystem() {
+	// the last level never gets restarted, so it reports here
+	projectile_pool.reportHighWaterMark();
+
 	// Destroy music components
 	if (background_music != nullptr)
 		Mix_FreeMusic(background_music);
@@ -284,6 +288,23 @@ void animateLostSoul(Entity& lost_soul) {
 bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	std::stringstream title_ss;
 	title_ss << "Aria: Whispers of Darkness";
+	if (debugging.show_render_stats) {
+		const RenderStats stats = renderer->getRenderStats();
+		title_ss << " | Draw calls: " << stats.draw_calls
+			<< " | Sprite batches: " << stats.sprite_batches
+			<< " | Batched sprites: " << stats.batched_sprites
+			<< " | Text batches: " << stats.text_batches
+			<< " | Text layouts: " << stats.text_layouts
+			<< " | HUD redraws: " << stats.hud_redraws
+			<< " | Particle bursts: " << stats.particle_bursts
+			<< " | Program changes: " << stats.program_changes
+			<< " | Texture changes: " << stats.texture_changes
+			<< " | Lights: " << stats.lights
+			<< " | Visible: " << stats.visible_entities
+			<< " | Culled: " << stats.culled_entities
+			<< " | GPU ms: " << stats.gpu_ms
+			<< " | Render scale: " << stats.render_scale;
+	}
 	glfwSetWindowTitle(window, title_ss.str().c_str());
 
 	// Remove debug info from the last step
@@ -589,8 +610,9 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	}
 
 
-	if (registry.lifeOrbs.entities.size() > 0) {
-		createShadow(renderer, player, TEXTURE_ASSET_ID::PLAYER, GEOMETRY_BUFFER_ID::PLAYER);
+	// the life orb lights the scene, so Aria casts a shadow from then on
+	if (registry.lifeOrbs.entities.size() > 0 && !registry.castsShadows.has(player)) {
+		addShadow(player, TEXTURE_ASSET_ID::PLAYER, GEOMETRY_BUFFER_ID::PLAYER);
 	}
 	return true;
 }
@@ -600,6 +622,7 @@ void WorldSystem::restart_game() {
 	// Debugging for memory/component leaks
 	registry.list_all_components();
 	printf("Restarting\n");
+	projectile_pool.reportHighWaterMark();
 
 	// hacky solution to persist player components after restart
 	bool persistPowerUps = registry.powerUps.has(player);
@@ -743,6 +766,12 @@ void WorldSystem::restart_game() {
 
 	projectileSelectDisplay = createProjectileSelectDisplay(renderer, player, PROJECTILE_SELECT_DISPLAY_X_OFFSET, PROJECTILE_SELECT_DISPLAY_Y_OFFSET);
 
+	// preallocate this level's projectiles now that the player (and its power ups) exist
+	projectile_pool.init(renderer, player, curr_level);
+
+	// floors and walls don't change until the next restart
+	renderer->bakeStaticGeometry();
+
 	if (this->curr_level.getCurrLevel() == POWER_UP) display_power_up();
 	if (this->curr_level.getCurrLevel() == FINAL_BOSS) {
 		if (registry.bosses.size() > 0) {
@@ -944,6 +973,9 @@ void WorldSystem::handle_collisions() {
 		Entity entity = collisionsRegistry.entities[i];
 		Entity entity_other = collisionsRegistry.components[i].other_entity;
 
+		// projectiles already returned to the pool earlier in this loop no longer collide
+		if (isInactiveProjectile(entity) || isInactiveProjectile(entity_other)) continue;
+
 		// Checking Player - Enemy collisions
 		if (registry.enemies.has(entity_other) && registry.players.has(entity)) {
 			Enemy& enemy = registry.enemies.get(entity_other);
@@ -1099,7 +1131,7 @@ void WorldSystem::handle_collisions() {
 			if (registry.projectiles.get(entity).hostile && registry.projectiles.get(entity).type != registry.enemies.get(entity_other).type && !registry.bosses.has(entity_other)) {
 				// HEAL the target instead
 				registry.resources.get(entity_other).currentHealth += 5;
-				registry.remove_all_components_of_no_collision(entity); // delete projectile
+				projectile_pool.release(entity); // delete projectile
 				if (registry.resources.get(entity_other).currentHealth > registry.resources.get(entity_other).maxHealth) {
 					registry.resources.get(entity_other).currentHealth = registry.resources.get(entity_other).maxHealth;
 				}
@@ -1138,8 +1170,11 @@ void WorldSystem::handle_collisions() {
 					}
 					enemy_resource.currentHealth -= damage_dealt;
 				}
-		
-				registry.remove_all_components_of_no_collision(entity); // delete projectile
+
+				// sparks in the projectile's element, they live on the GPU so this adds no entities
+				const vec3 hit_color = registry.particleEmitters.get(entity).color;
+				renderer->emitParticles(PARTICLE_EFFECT::HIT_SPARK, registry.positions.get(entity).position, hit_color);
+				projectile_pool.release(entity); // delete projectile
 
 				printf("enemy hp: %f\n", enemy_resource.currentHealth);
 
@@ -1155,6 +1190,7 @@ void WorldSystem::handle_collisions() {
 						}
 					}
 
+					renderer->emitParticles(PARTICLE_EFFECT::DEATH_BURST, registry.positions.get(entity_other).position, hit_color);
 					registry.remove_all_components_of(enemy_resource.healthBar);
 					registry.remove_all_components_of_no_collision(entity_other);
 					Mix_PlayChannel(-1, enemy_death_sound, 0);
@@ -1200,7 +1236,8 @@ void WorldSystem::handle_collisions() {
 					if (this->curr_level.getCurrLevel() != FINAL_BOSS && !this->curr_level.getIsBossLevel()) Mix_PlayChannel(-1, aria_death_lsvl, 0);
 				}
 			}
-			registry.remove_all_components_of_no_collision(entity);
+			renderer->emitParticles(PARTICLE_EFFECT::HIT_SPARK, registry.positions.get(entity).position, registry.particleEmitters.get(entity).color);
+			projectile_pool.release(entity);
 		}
 
 		// Checking Terrain - Projectile collisions
@@ -1223,7 +1260,8 @@ void WorldSystem::handle_collisions() {
 				}
 			}
 			else {
-				registry.remove_all_components_of_no_collision(entity);
+				renderer->emitParticles(PARTICLE_EFFECT::HIT_SPARK, registry.positions.get(entity).position, registry.particleEmitters.get(entity).color);
+				projectile_pool.release(entity);
 			}
 		}
 
@@ -1234,7 +1272,7 @@ void WorldSystem::handle_collisions() {
 
 			// do nothing if this power up is already toggled on
 			if (*powerUpBlock.powerUpToggle) {
-				registry.remove_all_components_of_no_collision(entity); // remove projectile
+				projectile_pool.release(entity); // remove projectile
 				continue;
 			}
 
@@ -1266,7 +1304,7 @@ void WorldSystem::handle_collisions() {
 
 			Mix_PlayChannel(-1, power_up_sound, 0);
 
-			registry.remove_all_components_of_no_collision(entity); // remove projectile
+			projectile_pool.release(entity); // remove projectile
 		}
 
 		// Checking Player - Exit Door collision
@@ -1479,6 +1517,24 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		else ui_system->setState(PAUSE_MENU);
 	}
 
+	// Render stats in the window title
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F3) {
+		debugging.show_render_stats = !debugging.show_render_stats;
+	}
+
+	// Dynamic resolution of the world pass
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F4) {
+		debugging.dynamic_resolution = !debugging.dynamic_resolution;
+	}
+
+#ifndef NDEBUG
+	// Synchronous glGetError checks, on top of the debug output callback
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F5) {
+		gl_error_checks = !gl_error_checks;
+		printf("glGetError checks %s\n", gl_error_checks ? "on" : "off");
+	}
+#endif
+
 	// Debugging
 	//if (key == GLFW_KEY_D) {
 	//	if (action == GLFW_RELEASE)
@@ -1525,13 +1581,16 @@ void WorldSystem::on_mouse_button(int button, int action, int mod) {
 			Velocity vel2 = computeVelocity(PROJECTILE_SPEED, angle);
 			Velocity vel3 = computeVelocity(PROJECTILE_SPEED, angle + 0.25);
 
-			Entity projectile1 = createProjectile(renderer, proj_position, vel1.velocity, elementType, false, player);
-			Entity projectile2 = createProjectile(renderer, proj_position, vel2.velocity, elementType, false, player);
-			Entity projectile3 = createProjectile(renderer, proj_position, vel3.velocity, elementType, false, player);
+			const ProjectileSpawn spawns[3] = {
+				{ proj_position, vel1.velocity, elementType, false },
+				{ proj_position, vel2.velocity, elementType, false },
+				{ proj_position, vel3.velocity, elementType, false }
+			};
+			projectile_pool.spawnBatch(spawns, 3);
 		}
 		else {
 			Velocity vel = computeVelocity(PROJECTILE_SPEED, angle);
-			Entity projectile = createProjectile(renderer, proj_position, vel.velocity, elementType, false, player);
+			projectile_pool.spawn({ proj_position, vel.velocity, elementType, false });
 		}
 		Mix_PlayChannel(-1, projectile_sound, 0);
 	}